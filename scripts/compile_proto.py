@@ -196,6 +196,9 @@ class ProtoTypeParser:
         else:
             return self.GetCppType()
 
+    def IsRawBytesType(self):
+        return self.typetype == 'basic' and self.name == 'bytes'
+
     def IsVarintType(self):
         return self.typetype == 'enum' or (self.typetype == 'basic'
                                            and self.name in VARINT_TYPES)
@@ -299,6 +302,9 @@ class ProtoFieldParser:
         name = self.name.group(0)
         if self.category == 'repeated':
             w.Write('%s_.clear();' % name)
+        elif self.type.IsRawBytesType():
+            w.Write('has_%s_ = false;' % name)
+            w.Write('%s_ = std::string_view();' % name)
         else:
             w.Write('has_%s_ = false;' % name)
             w.Write('%s_ = {};' % name)
@@ -376,6 +382,9 @@ class ProtoFieldParser:
     def GenerateVariable(self, w):
         name = self.name.group(0)
         cpp_type = self.type.GetVariableCppType()
+        if self.category != 'repeated' and self.type.IsRawBytesType():
+            # Large blobs, may refer to a buffer instead of copying it.
+            cpp_type = 'lczero::ProtoBytes'
         if self.category == 'repeated':
             w.Write("std::vector<%s> %s_;" % (cpp_type, name))
         else:
@@ -0,0 +1,249 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2024 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "benchmark/perft.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "chess/board.h"
+#include "utils/exception.h"
+#include "utils/hashcat.h"
+#include "utils/optionsparser.h"
+
+namespace lczero {
+namespace {
+const int kDefaultThreads = 1;
+
+const OptionId kThreadsOptionId{"threads", "Threads",
+                                "Number of (CPU) worker threads to use.", 't'};
+const OptionId kDepthId{
+    "depth", "",
+    "Perft depth. 0 means the default depth of every suite position."};
+const OptionId kFenId{"fen", "",
+                      "Position to run perft on instead of the suite."};
+const OptionId kHashId{
+    "hash", "",
+    "Size of the transposition table in MiB. 0 disables the table."};
+
+struct PerftPosition {
+  std::string fen;
+  int depth;
+  // Expected number of leaf nodes at the depth above, 0 if unknown.
+  uint64_t nodes;
+};
+
+// Positions from https://www.chessprogramming.org/Perft_Results, Chess960
+// positions, and positions checking castling, en passant, promotion and
+// check evasion edge cases.
+const PerftPosition kPerftPositions[] = {
+    {ChessBoard::kStartposFen, 6, 119060324},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5,
+     193690690},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+     15833292},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5, 89941194},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+     "10",
+     4, 3894594},
+    // Chess960.
+    {"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9", 5,
+     8146062},
+    {"2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9", 5,
+     16253601},
+    {"b1q1rrkb/pppppppp/3nn3/8/P7/1PPP4/4PPPP/BQNNRKRB w GE - 1 9", 5,
+     6417013},
+    // En passant.
+    {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467},
+    {"8/5bk1/8/2Pp4/8/1K6/8/8 w - d6 0 1", 6, 824064},
+    {"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6, 1134888},
+    {"8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1", 6, 1015133},
+    // Castling.
+    {"5k2/8/8/8/8/8/8/4K2R w K - 0 1", 6, 661072},
+    {"3k4/8/8/8/8/8/8/R3K3 w Q - 0 1", 6, 803711},
+    {"r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 4, 1274206},
+    {"r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4, 1720476},
+    // Promotions.
+    {"2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 6, 3821001},
+    {"4k3/1P6/8/8/8/8/K7/8 w - - 0 1", 6, 217342},
+    {"8/P1k5/K7/8/8/8/8/8 w - - 0 1", 6, 92683},
+    // Checks, stalemates and checkmates.
+    {"8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 5, 1004658},
+    {"K1k5/8/P7/8/8/8/8/8 w - - 0 1", 6, 2217},
+    {"8/k1P5/8/1K6/8/8/8/8 w - - 0 1", 7, 567584},
+    {"8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1", 4, 23527},
+};
+
+// Node counts of subtrees, shared by all threads. Entries are accessed
+// without locking: the key is stored xored with the count, so that entries
+// torn by concurrent writes don't match any key.
+class PerftTable {
+ public:
+  explicit PerftTable(size_t size_mb)
+      : entries_(size_mb * 1024 * 1024 / sizeof(Entry)) {}
+
+  bool empty() const { return entries_.empty(); }
+
+  void Clear() {
+    for (auto& entry : entries_) {
+      entry.check.store(0, std::memory_order_relaxed);
+      entry.nodes.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  bool Probe(uint64_t key, uint64_t* nodes) const {
+    const auto& entry = entries_[key % entries_.size()];
+    *nodes = entry.nodes.load(std::memory_order_relaxed);
+    return (entry.check.load(std::memory_order_relaxed) ^ *nodes) == key;
+  }
+
+  void Store(uint64_t key, uint64_t nodes) {
+    auto& entry = entries_[key % entries_.size()];
+    entry.check.store(key ^ nodes, std::memory_order_relaxed);
+    entry.nodes.store(nodes, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check{0};
+    std::atomic<uint64_t> nodes{0};
+  };
+  std::vector<Entry> entries_;
+};
+
+uint64_t CountNodes(const ChessBoard& board, int depth, PerftTable* table) {
+  if (depth == 0) return 1;
+  // Leaves are counted without applying their moves.
+  if (depth == 1) return board.GenerateLegalMoves().size();
+  const uint64_t key = HashCat(board.Hash(), depth);
+  uint64_t nodes;
+  if (table && table->Probe(key, &nodes)) return nodes;
+  nodes = 0;
+  for (auto move : board.GenerateLegalMoves()) {
+    ChessBoard child = board;
+    child.ApplyMove(move);
+    child.Mirror();
+    nodes += CountNodes(child, depth - 1, table);
+  }
+  if (table) table->Store(key, nodes);
+  return nodes;
+}
+
+// Splits the root moves between the threads.
+uint64_t CountNodesParallel(const ChessBoard& board, int depth,
+                            PerftTable* table, int threads) {
+  if (depth <= 1) return CountNodes(board, depth, table);
+  const auto moves = board.GenerateLegalMoves();
+  std::atomic<size_t> next_move{0};
+  std::atomic<uint64_t> nodes{0};
+  auto worker = [&]() {
+    for (size_t i = next_move++; i < moves.size(); i = next_move++) {
+      ChessBoard child = board;
+      child.ApplyMove(moves[i]);
+      child.Mirror();
+      nodes += CountNodes(child, depth - 1, table);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; ++i) workers.emplace_back(worker);
+  worker();
+  for (auto& thread : workers) thread.join();
+  return nodes;
+}
+}  // namespace
+
+void Perft::Run() {
+  OptionsParser options;
+  options.Add<IntOption>(kThreadsOptionId, 1, 128) = kDefaultThreads;
+  options.Add<IntOption>(kDepthId, 0, 20) = 0;
+  options.Add<StringOption>(kFenId) = "";
+  options.Add<IntOption>(kHashId, 0, 65536) = 0;
+
+  if (!options.ProcessAllFlags()) return;
+
+  try {
+    auto option_dict = options.GetOptionsDict();
+    const int threads = option_dict.Get<int>(kThreadsOptionId);
+    const int depth = option_dict.Get<int>(kDepthId);
+    const std::string fen = option_dict.Get<std::string>(kFenId);
+
+    std::vector<PerftPosition> positions(std::begin(kPerftPositions),
+                                         std::end(kPerftPositions));
+    if (!fen.empty()) positions = {{fen, 5, 0}};
+    PerftTable table(option_dict.Get<int>(kHashId));
+
+    uint64_t total_nodes = 0;
+    double total_time = 0;
+    int mismatches = 0;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      const auto& position = positions[i];
+      std::cout << "\nPosition: " << i + 1 << "/" << positions.size() << " "
+                << position.fen << std::endl;
+      ChessBoard board(position.fen);
+      const int position_depth = depth > 0 ? depth : position.depth;
+      // Every position starts with an empty table to be measured alone.
+      if (!table.empty()) table.Clear();
+
+      const auto start = std::chrono::steady_clock::now();
+      const uint64_t nodes = CountNodesParallel(
+          board, position_depth, table.empty() ? nullptr : &table, threads);
+      const auto end = std::chrono::steady_clock::now();
+      const double time = std::chrono::duration<double>(end - start).count();
+      total_nodes += nodes;
+      total_time += time;
+
+      std::cout << "Depth " << position_depth << ": " << nodes << " nodes, "
+                << std::lround(time * 1000) << " ms, "
+                << std::llround(nodes / (time + 1e-9)) << " nps";
+      if (position.nodes && position_depth == position.depth) {
+        if (nodes == position.nodes) {
+          std::cout << ", OK";
+        } else {
+          std::cout << ", MISMATCH (expected " << position.nodes << ")";
+          ++mismatches;
+        }
+      }
+      std::cout << std::endl;
+    }
+
+    std::cout << "\n==========================="
+              << "\nTotal time (ms) : " << std::lround(total_time * 1000)
+              << "\nNodes searched  : " << total_nodes
+              << "\nNodes/second    : "
+              << std::llround(total_nodes / (total_time + 1e-9))
+              << "\nMismatches      : " << mismatches << std::endl;
+  } catch (Exception& ex) {
+    std::cerr << ex.what() << std::endl;
+  }
+}
+
+}  // namespace lczero
@@ -27,13 +27,17 @@
 
 #include "chess/bitboard.h"
 
+#include <array>
+#include <iterator>
+
 #include "utils/exception.h"
 
 namespace lczero {
 
 namespace {
 
-const Move kIdxToMove[] = {
+// Moves in the order of their NN indices.
+constexpr const char* kIdxToMove[] = {
     "a1b1",  "a1c1",  "a1d1",  "a1e1",  "a1f1",  "a1g1",  "a1h1",  "a1a2",
     "a1b2",  "a1c2",  "a1a3",  "a1b3",  "a1c3",  "a1a4",  "a1d4",  "a1a5",
     "a1e5",  "a1a6",  "a1f6",  "a1a7",  "a1g7",  "a1a8",  "a1h8",  "b1a1",
@@ -268,32 +272,51 @@ const Move kIdxToMove[] = {
     "g7g8b", "g7h8q", "g7h8r", "g7h8b", "h7g8q", "h7g8r", "h7g8b", "h7h8q",
     "h7h8r", "h7h8b"};
 
-std::vector<unsigned short> BuildMoveIndices() {
-  std::vector<unsigned short> res(4 * 64 * 64);
-  for (size_t i = 0; i < sizeof(kIdxToMove) / sizeof(kIdxToMove[0]); ++i) {
-    res[kIdxToMove[i].as_packed_int()] = i;
+// Index of a move in UCI notation in kMoveToIdx, see Move::as_packed_int().
+constexpr int PackedIndex(const char* str) {
+  const int from = (str[1] - '1') * 8 + (str[0] - 'a');
+  const int to = (str[3] - '1') * 8 + (str[2] - 'a');
+  const Move::Promotion promotion = str[4] == 'q'   ? Move::Promotion::Queen
+                                    : str[4] == 'r' ? Move::Promotion::Rook
+                                    : str[4] == 'b' ? Move::Promotion::Bishop
+                                                    : Move::Promotion::None;
+  return static_cast<int>(promotion) * 64 * 64 + from * 64 + to;
+}
+
+constexpr std::array<uint16_t, 4 * 64 * 64> kMoveToIdx = [] {
+  std::array<uint16_t, 4 * 64 * 64> res{};
+  for (size_t i = 0; i < std::size(kIdxToMove); ++i) {
+    res[PackedIndex(kIdxToMove[i])] = i;
   }
   return res;
-}
+}();
+constexpr int kKingCastleIndex = kMoveToIdx[PackedIndex("e1h1")];
+constexpr int kQueenCastleIndex = kMoveToIdx[PackedIndex("e1a1")];
 
-const std::vector<unsigned short> kMoveToIdx = BuildMoveIndices();
-const int kKingCastleIndex =
-    kMoveToIdx[BoardSquare("e1").as_int() * 64 + BoardSquare("h1").as_int()];
-const int kQueenCastleIndex =
-    kMoveToIdx[BoardSquare("e1").as_int() * 64 + BoardSquare("a1").as_int()];
+// Offsets of the promotions in kMoveToIdx. Knight promotions are packed as
+// moves without promotion.
+constexpr uint16_t kPromotionOffsets[] = {0, 1 * 64 * 64, 2 * 64 * 64,
+                                          3 * 64 * 64, 0};
 
-BoardSquare Transform(BoardSquare sq, int transform) {
-  if ((transform & FlipTransform) != 0) {
-    sq.set(sq.row(), 7 - sq.col());
-  }
-  if ((transform & MirrorTransform) != 0) {
-    sq.set(7 - sq.row(), sq.col());
-  }
-  if ((transform & TransposeTransform) != 0) {
-    sq.set(7 - sq.col(), 7 - sq.row());
+// Every square after each transform.
+constexpr std::array<std::array<uint8_t, 64>, 8> kTransformedSquares = [] {
+  std::array<std::array<uint8_t, 64>, 8> res{};
+  for (int transform = 0; transform < 8; ++transform) {
+    for (int square = 0; square < 64; ++square) {
+      int row = square / 8;
+      int col = square % 8;
+      if ((transform & FlipTransform) != 0) col = 7 - col;
+      if ((transform & MirrorTransform) != 0) row = 7 - row;
+      if ((transform & TransposeTransform) != 0) {
+        const int transposed_row = 7 - col;
+        col = 7 - row;
+        row = transposed_row;
+      }
+      res[transform][square] = row * 8 + col;
+    }
   }
-  return sq;
-}
+  return res;
+}();
 }  // namespace
 
 Move::Move(const std::string& str, bool black) {
@@ -326,22 +349,14 @@ Move::Move(const std::string& str, bool black) {
 }
 
 uint16_t Move::as_packed_int() const {
-  if (promotion() == Promotion::Knight) {
-    return from().as_int() * 64 + to().as_int();
-  } else {
-    return static_cast<int>(promotion()) * 64 * 64 + from().as_int() * 64 +
-           to().as_int();
-  }
+  return kPromotionOffsets[(data_ & kPromoMask) >> 12] +
+         (data_ & (kFromMask | kToMask));
 }
 
 uint16_t Move::as_nn_index(int transform) const {
-  if (transform == 0) {
-    return kMoveToIdx[as_packed_int()];
-  }
-  Move transformed = *this;
-  transformed.SetTo(Transform(to(), transform));
-  transformed.SetFrom(Transform(from(), transform));
-  return transformed.as_nn_index(0);
+  const auto& squares = kTransformedSquares[transform];
+  return kMoveToIdx[kPromotionOffsets[(data_ & kPromoMask) >> 12] +
+                    squares[from().as_int()] * 64 + squares[to().as_int()]];
 }
 
 }  // namespace lczero
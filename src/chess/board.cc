@@ -53,6 +53,71 @@ void ChessBoard::Clear() {
   std::memset(reinterpret_cast<void*>(this), 0, sizeof(ChessBoard));
 }
 
+namespace {
+// Pseudorandom keys for Zobrist hashing. Pieces are keyed by their absolute
+// square in the planes: white pieces, black pieces, rooks, bishops, pawns
+// (including the en passant flags) and kings.
+struct ZobristKeys {
+  uint64_t pieces[6][64];
+  uint64_t castlings[16];
+  uint64_t black_to_move;
+};
+
+constexpr uint64_t SplitMix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys kZobrist = [] {
+  ZobristKeys keys{};
+  uint64_t state = 0x6c63305a6f627269ULL;
+  for (auto& plane : keys.pieces) {
+    for (auto& key : plane) key = SplitMix64(&state);
+  }
+  for (auto& key : keys.castlings) key = SplitMix64(&state);
+  // So that an empty board, e.g. after Clear(), has a zero key.
+  keys.castlings[0] = 0;
+  keys.black_to_move = SplitMix64(&state);
+  return keys;
+}();
+
+// Combined keys of pieces of a given plane on the given squares.
+uint64_t PlaneHash(int plane, BitBoard squares, bool flipped) {
+  const int flip = flipped ? 0b111000 : 0;
+  uint64_t hash = 0;
+  for (auto square : squares) {
+    hash ^= kZobrist.pieces[plane][square.as_int() ^ flip];
+  }
+  return hash;
+}
+
+// Combined keys of the pieces given as raw bitboards of a board (or their
+// differences between two boards).
+uint64_t PiecesHash(uint64_t ours, uint64_t theirs, uint64_t rooks,
+                    uint64_t bishops, uint64_t pawns, uint64_t kings,
+                    bool flipped) {
+  return PlaneHash(flipped ? 1 : 0, ours, flipped) ^
+         PlaneHash(flipped ? 0 : 1, theirs, flipped) ^
+         PlaneHash(2, rooks, flipped) ^ PlaneHash(3, bishops, flipped) ^
+         PlaneHash(4, pawns, flipped) ^ PlaneHash(5, kings, flipped);
+}
+
+uint64_t CastlingsHash(ChessBoard::Castlings castlings, bool flipped) {
+  if (flipped) castlings.Mirror();
+  return kZobrist.castlings[castlings.as_int()];
+}
+}  // namespace
+
+uint64_t ChessBoard::ComputeHash() const {
+  return PiecesHash(our_pieces_.as_int(), their_pieces_.as_int(),
+                    rooks_.as_int(), bishops_.as_int(), pawns_.as_int(),
+                    kings().as_int(), flipped_) ^
+         CastlingsHash(castlings_, flipped_) ^
+         (flipped_ ? kZobrist.black_to_move : 0);
+}
+
 void ChessBoard::Mirror() {
   our_pieces_.Mirror();
   their_pieces_.Mirror();
@@ -65,6 +130,7 @@ void ChessBoard::Mirror() {
   std::swap(our_king_, their_king_);
   castlings_.Mirror();
   flipped_ = !flipped_;
+  hash_ ^= kZobrist.black_to_move;
 }
 
 namespace {
@@ -174,6 +240,61 @@ static const BitBoard kPawnAttacks[] = {
     0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
     0x0000000000000000ULL};
 
+namespace {
+// Lines through pairs of squares, computed at compile time. For two squares on
+// a common rank, file or diagonal, `between` holds the squares strictly between
+// them and `line` the whole line through both; otherwise both are empty.
+struct LineTables {
+  uint64_t between[64][64];
+  uint64_t line[64][64];
+};
+
+constexpr LineTables kLineTables = [] {
+  LineTables tables{};
+  constexpr int kDirections[8][2] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                                     {1, 1},  {-1, 1}, {1, -1}, {-1, -1}};
+  for (int from = 0; from < 64; ++from) {
+    for (const auto& direction : kDirections) {
+      // The squares of the ray from @from in the direction and the opposite.
+      uint64_t ray = 0;
+      uint64_t back_ray = 0;
+      for (int row = from / 8 + direction[0], col = from % 8 + direction[1];
+           row >= 0 && row < 8 && col >= 0 && col < 8;
+           row += direction[0], col += direction[1]) {
+        ray |= 1ULL << (row * 8 + col);
+      }
+      for (int row = from / 8 - direction[0], col = from % 8 - direction[1];
+           row >= 0 && row < 8 && col >= 0 && col < 8;
+           row -= direction[0], col -= direction[1]) {
+        back_ray |= 1ULL << (row * 8 + col);
+      }
+      uint64_t between = 0;
+      for (int row = from / 8 + direction[0], col = from % 8 + direction[1];
+           row >= 0 && row < 8 && col >= 0 && col < 8;
+           row += direction[0], col += direction[1]) {
+        const int to = row * 8 + col;
+        tables.between[from][to] = between;
+        tables.line[from][to] = ray | back_ray | (1ULL << from);
+        between |= 1ULL << to;
+      }
+    }
+  }
+  return tables;
+}();
+
+// Returns the squares strictly between two squares on a common line, or an
+// empty board if they are not on one.
+BitBoard GetSquaresBetween(BoardSquare a, BoardSquare b) {
+  return kLineTables.between[a.as_int()][b.as_int()];
+}
+
+// Returns the whole line through two squares on a common line, or an empty
+// board if they are not on one.
+BitBoard GetLineThrough(BoardSquare a, BoardSquare b) {
+  return kLineTables.line[a.as_int()][b.as_int()];
+}
+}  // namespace
+
 static const Move::Promotion kPromotions[] = {
     Move::Promotion::Queen,
     Move::Promotion::Rook,
@@ -425,6 +546,37 @@ void InitializeMagicBitboards() {
                     kBishopDirections);
 }
 
+void ChessBoard::GenerateCastlings(MoveList* moves) const {
+  // The squares the king and the rook pass, destinations included, have to be
+  // empty except for the two of them. The squares the king passes, its
+  // destination excluded, can't be attacked. Destination king square is not
+  // checked for checks, it's up to the caller.
+  auto can_castle = [this](BoardSquare rook, BoardSquare king_to,
+                           BoardSquare rook_to) {
+    const BitBoard king_path =
+        GetSquaresBetween(our_king_, king_to) | king_to.as_board();
+    const BitBoard rook_path =
+        GetSquaresBetween(rook, rook_to) | rook_to.as_board();
+    if ((king_path | rook_path)
+            .intersects((our_pieces_ | their_pieces_) - our_king_ - rook)) {
+      return false;
+    }
+    for (auto square :
+         GetSquaresBetween(our_king_, king_to) | our_king_.as_board()) {
+      if (IsUnderAttack(square)) return false;
+    }
+    return true;
+  };
+  if (castlings_.we_can_000()) {
+    const BoardSquare rook(RANK_1, castlings_.queenside_rook());
+    if (can_castle(rook, C1, D1)) moves->emplace_back(our_king_, rook);
+  }
+  if (castlings_.we_can_00()) {
+    const BoardSquare rook(RANK_1, castlings_.kingside_rook());
+    if (can_castle(rook, G1, F1)) moves->emplace_back(our_king_, rook);
+  }
+}
+
 MoveList ChessBoard::GeneratePseudolegalMoves() const {
   MoveList result;
   result.reserve(60);
@@ -440,46 +592,7 @@ MoveList ChessBoard::GeneratePseudolegalMoves() const {
         if (IsUnderAttack(destination)) continue;
         result.emplace_back(source, destination);
       }
-      // Castlings.
-      auto walk_free = [this](int from, int to, int rook, int king) {
-        for (int i = from; i <= to; ++i) {
-          if (i == rook || i == king) continue;
-          if (our_pieces_.get(i) || their_pieces_.get(i)) return false;
-        }
-        return true;
-      };
-      // @From may be less or greater than @to. @To is not included in check
-      // unless it is the same with @from.
-      auto range_attacked = [this](int from, int to) {
-        if (from == to) return IsUnderAttack(from);
-        const int increment = from < to ? 1 : -1;
-        while (from != to) {
-          if (IsUnderAttack(from)) return true;
-          from += increment;
-        }
-        return false;
-      };
-      const uint8_t king = source.col();
-      // For castlings we don't check destination king square for checks, it
-      // will be done in legal move check phase.
-      if (castlings_.we_can_000()) {
-        const uint8_t qrook = castlings_.queenside_rook();
-        if (walk_free(std::min(static_cast<uint8_t>(C1), qrook),
-                      std::max(static_cast<uint8_t>(D1), king), qrook, king) &&
-            !range_attacked(king, C1)) {
-          result.emplace_back(source,
-                              BoardSquare(RANK_1, castlings_.queenside_rook()));
-        }
-      }
-      if (castlings_.we_can_00()) {
-        const uint8_t krook = castlings_.kingside_rook();
-        if (walk_free(std::min(static_cast<uint8_t>(F1), king),
-                      std::max(static_cast<uint8_t>(G1), krook), krook, king) &&
-            !range_attacked(king, G1)) {
-          result.emplace_back(source,
-                              BoardSquare(RANK_1, castlings_.kingside_rook()));
-        }
-      }
+      GenerateCastlings(&result);
       continue;
     }
     bool processed_piece = false;
@@ -569,6 +682,23 @@ MoveList ChessBoard::GeneratePseudolegalMoves() const {
 }  // namespace lczero
 
 bool ChessBoard::ApplyMove(Move move) {
+  const ChessBoard before = *this;
+  const bool reset_50_moves = ApplyMoveToPieces(move);
+  // Only the few squares the move changed are rehashed.
+  hash_ ^= PiecesHash(before.our_pieces_.as_int() ^ our_pieces_.as_int(),
+                      before.their_pieces_.as_int() ^ their_pieces_.as_int(),
+                      before.rooks_.as_int() ^ rooks_.as_int(),
+                      before.bishops_.as_int() ^ bishops_.as_int(),
+                      before.pawns_.as_int() ^ pawns_.as_int(),
+                      before.kings().as_int() ^ kings().as_int(), flipped_);
+  if (!(before.castlings_ == castlings_)) {
+    hash_ ^= CastlingsHash(before.castlings_, flipped_) ^
+             CastlingsHash(castlings_, flipped_);
+  }
+  return reset_50_moves;
+}
+
+bool ChessBoard::ApplyMoveToPieces(Move move) {
   const auto& from = move.from();
   const auto& to = move.to();
   const auto from_row = from.row();
@@ -695,6 +825,10 @@ bool ChessBoard::ApplyMove(Move move) {
 }
 
 bool ChessBoard::IsUnderAttack(BoardSquare square) const {
+  return IsUnderAttack(square, our_pieces_ | their_pieces_);
+}
+
+bool ChessBoard::IsUnderAttack(BoardSquare square, BitBoard occupied) const {
   const int row = square.row();
   const int col = square.col();
   // Check king.
@@ -704,12 +838,12 @@ bool ChessBoard::IsUnderAttack(BoardSquare square) const {
     if (std::abs(krow - row) <= 1 && std::abs(kcol - col) <= 1) return true;
   }
   // Check rooks (and queens).
-  if (GetRookAttacks(square, our_pieces_ | their_pieces_)
+  if (GetRookAttacks(square, occupied)
           .intersects(their_pieces_ & rooks_)) {
     return true;
   }
   // Check bishops.
-  if (GetBishopAttacks(square, our_pieces_ | their_pieces_)
+  if (GetBishopAttacks(square, occupied)
           .intersects(their_pieces_ & bishops_)) {
     return true;
   }
@@ -766,93 +900,24 @@ KingAttackInfo ChessBoard::GenerateKingAttackInfo() const {
   // Number of attackers that give check (used for double check detection).
   unsigned num_king_attackers = 0;
 
-  const int row = our_king_.row();
-  const int col = our_king_.col();
   // King checks are unnecessary, as kings cannot give check.
-  // Check rooks (and queens).
-  if (kRookAttacks[our_king_.as_int()].intersects(their_pieces_ & rooks_)) {
-    for (const auto& direction : kRookDirections) {
-      auto dst_row = row;
-      auto dst_col = col;
-      BitBoard attack_line(0);
-      bool possible_pinned_piece_found = false;
-      BoardSquare possible_pinned_piece;
-      while (true) {
-        dst_row += direction.first;
-        dst_col += direction.second;
-        if (!BoardSquare::IsValid(dst_row, dst_col)) break;
-        const BoardSquare destination(dst_row, dst_col);
-        if (our_pieces_.get(destination)) {
-          if (possible_pinned_piece_found) {
-            // No pieces pinned.
-            break;
-          } else {
-            // This is a possible pinned piece.
-            possible_pinned_piece_found = true;
-            possible_pinned_piece = destination;
-          }
-        }
-        if (!possible_pinned_piece_found) {
-          attack_line.set(destination);
-        }
-        if (their_pieces_.get(destination)) {
-          if (rooks_.get(destination)) {
-            if (possible_pinned_piece_found) {
-              // Store the pinned piece.
-              king_attack_info.pinned_pieces_.set(possible_pinned_piece);
-            } else {
-              // Update attack lines.
-              king_attack_info.attack_lines_ =
-                  king_attack_info.attack_lines_ | attack_line;
-              num_king_attackers++;
-            }
-          }
-          break;
-        }
-      }
-    }
-  }
-  // Check bishops.
-  if (kBishopAttacks[our_king_.as_int()].intersects(their_pieces_ & bishops_)) {
-    for (const auto& direction : kBishopDirections) {
-      auto dst_row = row;
-      auto dst_col = col;
-      BitBoard attack_line(0);
-      bool possible_pinned_piece_found = false;
-      BoardSquare possible_pinned_piece;
-      while (true) {
-        dst_row += direction.first;
-        dst_col += direction.second;
-        if (!BoardSquare::IsValid(dst_row, dst_col)) break;
-        const BoardSquare destination(dst_row, dst_col);
-        if (our_pieces_.get(destination)) {
-          if (possible_pinned_piece_found) {
-            // No pieces pinned.
-            break;
-          } else {
-            // This is a possible pinned piece.
-            possible_pinned_piece_found = true;
-            possible_pinned_piece = destination;
-          }
-        }
-        if (!possible_pinned_piece_found) {
-          attack_line.set(destination);
-        }
-        if (their_pieces_.get(destination)) {
-          if (bishops_.get(destination)) {
-            if (possible_pinned_piece_found) {
-              // Store the pinned piece.
-              king_attack_info.pinned_pieces_.set(possible_pinned_piece);
-            } else {
-              // Update attack lines.
-              king_attack_info.attack_lines_ =
-                  king_attack_info.attack_lines_ | attack_line;
-              num_king_attackers++;
-            }
-          }
-          break;
-        }
-      }
+  // Rooks, bishops and queens on a line with the king give check if nothing
+  // stands between, and pin our piece if it's the only one between.
+  const BitBoard snipers =
+      (kRookAttacks[our_king_.as_int()] & their_pieces_ & rooks_) |
+      (kBishopAttacks[our_king_.as_int()] & their_pieces_ & bishops_);
+  for (auto sniper : snipers) {
+    const BitBoard between = GetSquaresBetween(our_king_, sniper);
+    const BitBoard blockers = between & (our_pieces_ | their_pieces_);
+    if (blockers.empty()) {
+      // Update attack lines.
+      king_attack_info.attack_lines_ =
+          king_attack_info.attack_lines_ | between | sniper.as_board();
+      num_king_attackers++;
+    } else if (blockers.count_few() == 1 && blockers.intersects(our_pieces_)) {
+      // Store the pinned piece.
+      king_attack_info.pinned_pieces_ =
+          king_attack_info.pinned_pieces_ | blockers;
     }
   }
   // Check pawns.
@@ -945,25 +1010,161 @@ bool ChessBoard::IsLegalMove(Move move,
 
   // The piece is pinned. Now check that it stays on the same line w.r.t. the
   // king.
-  const int dx_from = from.col() - our_king_.col();
-  const int dy_from = from.row() - our_king_.row();
-  const int dx_to = to.col() - our_king_.col();
-  const int dy_to = to.row() - our_king_.row();
-
-  if (dx_from == 0 || dx_to == 0) {
-    return (dx_from == dx_to);
-  } else {
-    return (dx_from * dy_to == dx_to * dy_from);
-  }
+  return GetLineThrough(our_king_, from).get(to);
 }
 
 MoveList ChessBoard::GenerateLegalMoves() const {
-  const KingAttackInfo king_attack_info = GenerateKingAttackInfo();
-  MoveList result = GeneratePseudolegalMoves();
-  result.erase(
-      std::remove_if(result.begin(), result.end(),
-                     [&](Move m) { return !IsLegalMove(m, king_attack_info); }),
-      result.end());
+  // Generates moves in the same order as GeneratePseudolegalMoves(), but
+  // restricts destinations with check and pin masks instead of filtering the
+  // generated moves.
+  MoveList result;
+  result.reserve(60);
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  const BitBoard their_knights = their_pieces_ - their_king_ - rooks_ -
+                                 bishops_ - (pawns_ & kPawnMask);
+
+  // Non-king moves have to capture the checker or block the check.
+  const BitBoard checkers =
+      (GetRookAttacks(our_king_, occupied) & their_pieces_ & rooks_) |
+      (GetBishopAttacks(our_king_, occupied) & their_pieces_ & bishops_) |
+      (kKnightAttacks[our_king_.as_int()] & their_knights) |
+      (kPawnAttacks[our_king_.as_int()] & their_pieces_ & pawns_);
+  const int num_checkers = checkers.count();
+  BitBoard check_mask = ~0ULL;
+  if (num_checkers == 1) {
+    const BoardSquare checker = *checkers.begin();
+    check_mask = GetSquaresBetween(our_king_, checker) | checker.as_board();
+  }
+
+  // Our pieces which are the only piece between the king and their slider.
+  BitBoard pinned = 0;
+  const BitBoard snipers =
+      ((GetRookAttacks(our_king_, their_pieces_) & rooks_) |
+       (GetBishopAttacks(our_king_, their_pieces_) & bishops_)) &
+      their_pieces_;
+  for (auto sniper : snipers) {
+    const BitBoard blockers =
+        GetSquaresBetween(our_king_, sniper) & our_pieces_;
+    if (blockers.count() == 1) pinned = pinned | blockers;
+  }
+
+  // En passant and castling are rare, so they are just applied and checked.
+  auto is_legal_after = [this](Move move) {
+    ChessBoard board(*this);
+    board.ApplyMove(move);
+    return !board.IsUnderCheck();
+  };
+
+  for (auto source : our_pieces_) {
+    // King
+    if (source == our_king_) {
+      // The king doesn't shield squares behind it from sliders.
+      const BitBoard occupied_without_king = occupied - our_king_;
+      for (const auto& delta : kKingMoves) {
+        const auto dst_row = source.row() + delta.first;
+        const auto dst_col = source.col() + delta.second;
+        if (!BoardSquare::IsValid(dst_row, dst_col)) continue;
+        const BoardSquare destination(dst_row, dst_col);
+        if (our_pieces_.get(destination)) continue;
+        if (IsUnderAttack(destination, occupied_without_king)) continue;
+        result.emplace_back(source, destination);
+      }
+      if (num_checkers == 0) {
+        MoveList castlings;
+        GenerateCastlings(&castlings);
+        for (auto move : castlings) {
+          if (is_legal_after(move)) result.push_back(move);
+        }
+      }
+      continue;
+    }
+    // Only a king move can resolve a double check.
+    if (num_checkers > 1) continue;
+    BitBoard targets = check_mask;
+    if (pinned.get(source)) {
+      targets = targets & GetLineThrough(our_king_, source);
+    }
+    bool processed_piece = false;
+    // Rook (and queen)
+    if (rooks_.get(source)) {
+      processed_piece = true;
+      BitBoard attacked =
+          (GetRookAttacks(source, occupied) & targets) - our_pieces_;
+      for (const auto& destination : attacked) {
+        result.emplace_back(source, destination);
+      }
+    }
+    // Bishop (and queen)
+    if (bishops_.get(source)) {
+      processed_piece = true;
+      BitBoard attacked =
+          (GetBishopAttacks(source, occupied) & targets) - our_pieces_;
+      for (const auto& destination : attacked) {
+        result.emplace_back(source, destination);
+      }
+    }
+    if (processed_piece) continue;
+    // Pawns.
+    if ((pawns_ & kPawnMask).get(source)) {
+      // Moves forward.
+      {
+        const auto dst_row = source.row() + 1;
+        const auto dst_col = source.col();
+        const BoardSquare destination(dst_row, dst_col);
+
+        if (!occupied.get(destination)) {
+          if (dst_row != RANK_8) {
+            if (targets.get(destination)) {
+              result.emplace_back(source, destination);
+            }
+            if (dst_row == RANK_3 && !occupied.get(RANK_4, dst_col) &&
+                targets.get(RANK_4, dst_col)) {
+              // Moves two squares.
+              result.emplace_back(source, BoardSquare(RANK_4, dst_col));
+            }
+          } else if (targets.get(destination)) {
+            // Promotions
+            for (auto promotion : kPromotions) {
+              result.emplace_back(source, destination, promotion);
+            }
+          }
+        }
+      }
+      // Captures.
+      {
+        for (auto direction : {-1, 1}) {
+          const auto dst_row = source.row() + 1;
+          const auto dst_col = source.col() + direction;
+          if (dst_col < 0 || dst_col >= 8) continue;
+          const BoardSquare destination(dst_row, dst_col);
+          if (their_pieces_.get(destination)) {
+            if (!targets.get(destination)) continue;
+            if (dst_row == RANK_8) {
+              // Promotion.
+              for (auto promotion : kPromotions) {
+                result.emplace_back(source, destination, promotion);
+              }
+            } else {
+              // Ordinary capture.
+              result.emplace_back(source, destination);
+            }
+          } else if (dst_row == RANK_6 && pawns_.get(RANK_8, dst_col)) {
+            // En passant.
+            const Move move(source, destination);
+            if (is_legal_after(move)) result.push_back(move);
+          }
+        }
+      }
+      continue;
+    }
+    // Knight.
+    {
+      for (const auto destination :
+           (kKnightAttacks[source.as_int()] & targets) - our_pieces_) {
+        result.emplace_back(source, destination);
+      }
+    }
+  }
   return result;
 }
 
@@ -1107,6 +1308,7 @@ void ChessBoard::SetFromFen(std::string fen, int* rule50_ply, int* moves) {
       throw Exception("Bad fen string: " + fen + " wrong en passant rank");
     pawns_.set((square.row() == RANK_3) ? RANK_1 : RANK_8, square.col());
   }
+  hash_ = ComputeHash();
 
   if (who_to_move == "b" || who_to_move == "B") {
     Mirror();
@@ -94,7 +94,7 @@ class ChessBoard {
 
   // Checks whether at least one of the sides has mating material.
   bool HasMatingMaterial() const;
-  // Generates legal moves.
+  // Generates legal moves, in the same order as GeneratePseudolegalMoves().
   MoveList GenerateLegalMoves() const;
   // Check whether pseudolegal move is legal.
   bool IsLegalMove(Move move, const KingAttackInfo& king_attack_info) const;
@@ -105,14 +105,10 @@ class ChessBoard {
   // Returns the same move but with castling encoded in modern way.
   Move GetModernMove(Move move) const;
 
-  uint64_t Hash() const {
-    return HashCat({our_pieces_.as_int(), their_pieces_.as_int(),
-                    rooks_.as_int(), bishops_.as_int(), pawns_.as_int(),
-                    (static_cast<uint32_t>(our_king_.as_int()) << 24) |
-                        (static_cast<uint32_t>(their_king_.as_int()) << 16) |
-                        (static_cast<uint32_t>(castlings_.as_int()) << 8) |
-                        static_cast<uint32_t>(flipped_)});
-  }
+  // Zobrist key of the position. It's maintained incrementally and doesn't
+  // depend on which side the board is viewed from, so Mirror() only toggles
+  // the side to move.
+  uint64_t Hash() const { return hash_; }
 
   class Castlings {
    public:
@@ -254,6 +250,16 @@ class ChessBoard {
   };
 
  private:
+  // Checks if the square is under attack from "theirs" (black) with the given
+  // squares occupied.
+  bool IsUnderAttack(BoardSquare square, BitBoard occupied) const;
+  // Appends castlings which are possible if the king doesn't end in check.
+  void GenerateCastlings(MoveList* moves) const;
+  // ApplyMove() without the update of the hash.
+  bool ApplyMoveToPieces(Move move);
+  // Computes the Zobrist key from scratch.
+  uint64_t ComputeHash() const;
+
   // All white pieces.
   BitBoard our_pieces_;
   // All black pieces.
@@ -272,6 +278,8 @@ class ChessBoard {
   BoardSquare their_king_;
   Castlings castlings_;
   bool flipped_ = false;  // aka "Black to move".
+  // Zobrist key, see Hash().
+  uint64_t hash_ = 0;
 };
 
 }  // namespace lczero
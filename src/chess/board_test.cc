@@ -103,10 +103,14 @@ int Perft(const ChessBoard& board, int max_depth, bool dump = false,
 
   auto legal_moves = board.GenerateLegalMoves();
   auto iter = legal_moves.begin();
+  const auto king_attack_info = board.GenerateKingAttackInfo();
 
   for (const auto& move : moves) {
     auto new_board = board;
     new_board.ApplyMove(move);
+    EXPECT_EQ(board.IsLegalMove(move, king_attack_info),
+              !new_board.IsUnderCheck())
+        << board.DebugString() << "move:" << move.as_string();
     if (new_board.IsUnderCheck()) {
       if (iter != legal_moves.end()) {
         EXPECT_NE(iter->as_packed_int(), move.as_packed_int())
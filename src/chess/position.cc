@@ -62,20 +62,19 @@ char GetPieceAt(const lczero::ChessBoard& board, int row, int col) {
 namespace lczero {
 
 Position::Position(const Position& parent, Move m)
-    : rule50_ply_(parent.rule50_ply_ + 1), ply_count_(parent.ply_count_ + 1) {
-  them_board_ = parent.us_board_;
-  const bool is_zeroing = them_board_.ApplyMove(m);
-  us_board_ = them_board_;
+    : us_board_(parent.us_board_),
+      rule50_ply_(parent.rule50_ply_ + 1),
+      ply_count_(parent.ply_count_ + 1) {
+  const bool is_zeroing = us_board_.ApplyMove(m);
   us_board_.Mirror();
   if (is_zeroing) rule50_ply_ = 0;
 }
 
 Position::Position(const ChessBoard& board, int rule50_ply, int game_ply)
-    : rule50_ply_(rule50_ply), repetitions_(0), ply_count_(game_ply) {
-  us_board_ = board;
-  them_board_ = board;
-  them_board_.Mirror();
-}
+    : us_board_(board),
+      rule50_ply_(rule50_ply),
+      repetitions_(0),
+      ply_count_(game_ply) {}
 
 uint64_t Position::Hash() const {
   return HashCat({us_board_.Hash(), static_cast<unsigned long>(repetitions_)});
@@ -110,8 +109,11 @@ GameResult PositionHistory::ComputeGameResult() const {
 
 void PositionHistory::Reset(const ChessBoard& board, int rule50_ply,
                             int game_ply) {
+  prefix_.reset();
+  prefix_size_ = 0;
   positions_.clear();
   positions_.emplace_back(board, rule50_ply, game_ply);
+  UpdateLastHistoryHash();
 }
 
 void PositionHistory::Append(Move m) {
@@ -122,18 +124,59 @@ void PositionHistory::Append(Move m) {
   int cycle_length;
   int repetitions = ComputeLastMoveRepetitions(&cycle_length);
   positions_.back().SetRepetitions(repetitions, cycle_length);
+  UpdateLastHistoryHash();
+}
+
+namespace {
+// Multiplier of the polynomial rolling hash of the history.
+constexpr uint64_t kHistoryHashMul = 0x9fb21c651e98df25ULL;
+
+uint64_t HistoryHashMulPower(int exponent) {
+  uint64_t result = 1;
+  uint64_t base = kHistoryHashMul;
+  for (; exponent; exponent >>= 1, base *= base) {
+    if (exponent & 1) result *= base;
+  }
+  return result;
+}
+}  // namespace
+
+void PositionHistory::UpdateLastHistoryHash() {
+  const int length = GetLength();
+  const uint64_t previous =
+      length > 1 ? GetPositionAt(length - 2).GetHistoryHash() : 0;
+  positions_.back().SetHistoryHash(previous * kHistoryHashMul +
+                                   positions_.back().Hash());
+}
+
+PositionHistory PositionHistory::SharedCopy() const {
+  PositionHistory result;
+  if (positions_.empty() && prefix_ &&
+      static_cast<int>(prefix_->size()) == prefix_size_) {
+    result.prefix_ = prefix_;
+  } else {
+    auto positions = std::make_shared<std::vector<Position>>();
+    positions->reserve(GetLength());
+    for (int idx = 0; idx < GetLength(); ++idx) {
+      positions->push_back(GetPositionAt(idx));
+    }
+    result.prefix_ = std::move(positions);
+  }
+  result.prefix_size_ = result.prefix_->size();
+  return result;
 }
 
 int PositionHistory::ComputeLastMoveRepetitions(int* cycle_length) const {
   *cycle_length = 0;
-  const auto& last = positions_.back();
+  const auto& last = Last();
   // TODO(crem) implement hash/cache based solution.
   if (last.GetRule50Ply() < 4) return 0;
 
-  for (int idx = positions_.size() - 3; idx >= 0; idx -= 2) {
-    const auto& pos = positions_[idx];
-    if (pos.GetBoard() == last.GetBoard()) {
-      *cycle_length = positions_.size() - 1 - idx;
+  for (int idx = GetLength() - 3; idx >= 0; idx -= 2) {
+    const auto& pos = GetPositionAt(idx);
+    if (pos.GetBoard().Hash() == last.GetBoard().Hash() &&
+        pos.GetBoard() == last.GetBoard()) {
+      *cycle_length = GetLength() - 1 - idx;
       return 1 + pos.GetRepetitions();
     }
     if (pos.GetRule50Ply() < 2) return 0;
@@ -142,27 +185,30 @@ int PositionHistory::ComputeLastMoveRepetitions(int* cycle_length) const {
 }
 
 bool PositionHistory::DidRepeatSinceLastZeroingMove() const {
-  for (auto iter = positions_.rbegin(), end = positions_.rend(); iter != end;
-       ++iter) {
-    if (iter->GetRepetitions() > 0) return true;
-    if (iter->GetRule50Ply() == 0) return false;
+  for (int idx = GetLength() - 1; idx >= 0; --idx) {
+    const auto& pos = GetPositionAt(idx);
+    if (pos.GetRepetitions() > 0) return true;
+    if (pos.GetRule50Ply() == 0) return false;
   }
   return false;
 }
 
 uint64_t PositionHistory::HashLast(int positions) const {
-  uint64_t hash = positions;
-  for (auto iter = positions_.rbegin(), end = positions_.rend(); iter != end;
-       ++iter) {
-    if (!positions--) break;
-    hash = HashCat(hash, iter->Hash());
+  // The hash of positions [first, last] is the difference of the rolling
+  // hashes of last and first - 1.
+  const int length = GetLength();
+  uint64_t hash = Last().GetHistoryHash();
+  if (positions < length) {
+    hash -= GetPositionAt(length - 1 - positions).GetHistoryHash() *
+            HistoryHashMulPower(positions);
   }
-  return HashCat(hash, Last().GetRule50Ply());
+  return HashCat({static_cast<uint64_t>(positions), hash,
+                  static_cast<uint64_t>(Last().GetRule50Ply())});
 }
 
 std::string GetFen(const Position& pos) {
   std::string result;
-  const ChessBoard& board = pos.GetWhiteBoard();
+  const ChessBoard board = pos.GetWhiteBoard();
   for (int row = 7; row >= 0; --row) {
     int emptycounter = 0;
     for (int col = 0; col < 8; ++col) {
@@ -27,12 +27,17 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "chess/board.h"
 
 namespace lczero {
 
+// A position of a game. Only the board from the point of view of the player to
+// move is stored, so that long histories stay small and cheap to copy; the
+// other views are mirrored from it on demand.
 class Position {
  public:
   // From parent position and move.
@@ -41,6 +46,9 @@ class Position {
   Position(const ChessBoard& board, int rule50_ply, int game_ply);
 
   uint64_t Hash() const;
+  // Rolling hash of the history up to this position, see
+  // PositionHistory::HashLast().
+  uint64_t GetHistoryHash() const { return history_hash_; }
   bool IsBlackToMove() const { return us_board_.flipped(); }
 
   // Number of half-moves since beginning of the game.
@@ -58,6 +66,7 @@ class Position {
     repetitions_ = repetitions;
     cycle_length_ = cycle_length;
   }
+  void SetHistoryHash(uint64_t hash) { history_hash_ = hash; }
 
   // Number of ply with no captures and pawn moves.
   int GetRule50Ply() const { return rule50_ply_; }
@@ -65,10 +74,14 @@ class Position {
   // Gets board from the point of view of player to move.
   const ChessBoard& GetBoard() const { return us_board_; }
   // Gets board from the point of view of opponent.
-  const ChessBoard& GetThemBoard() const { return them_board_; }
+  ChessBoard GetThemBoard() const {
+    ChessBoard board = us_board_;
+    board.Mirror();
+    return board;
+  }
   // Gets board from the point of view of the white player.
-  const ChessBoard& GetWhiteBoard() const {
-    return us_board_.flipped() ? them_board_ : us_board_;
+  ChessBoard GetWhiteBoard() const {
+    return us_board_.flipped() ? GetThemBoard() : us_board_;
   };
 
   std::string DebugString() const;
@@ -76,8 +89,6 @@ class Position {
  private:
   // The board from the point of view of the player to move.
   ChessBoard us_board_;
-  // The board from the point of view of opponent.
-  ChessBoard them_board_;
 
   // How many half-moves without capture or pawn move was there.
   int rule50_ply_ = 0;
@@ -87,6 +98,8 @@ class Position {
   int cycle_length_;
   // number of half-moves since beginning of the game.
   int ply_count_ = 0;
+  // Rolling hash of the history, set by PositionHistory.
+  uint64_t history_hash_ = 0;
 };
 
 // GetFen returns a FEN notation for the position.
@@ -96,6 +109,9 @@ std::string GetFen(const Position& pos);
 enum class GameResult : uint8_t { UNDECIDED, BLACK_WON, DRAW, WHITE_WON };
 GameResult operator-(const GameResult& res);
 
+// The positions of a game. A history may consist of an immutable prefix shared
+// with other histories (see SharedCopy()) followed by positions of its own, so
+// that copying it only copies the positions appended after the prefix.
 class PositionHistory {
  public:
   PositionHistory() = default;
@@ -105,26 +121,44 @@ class PositionHistory {
   PositionHistory& operator=(const PositionHistory& other) = default;
   PositionHistory& operator=(PositionHistory&& other) = default;  
 
+  // Returns a history with the same positions, all of them in a prefix shared
+  // by the returned history and all its copies.
+  PositionHistory SharedCopy() const;
+
   // Returns first position of the game (or fen from which it was initialized).
-  const Position& Starting() const { return positions_.front(); }
+  const Position& Starting() const { return GetPositionAt(0); }
 
   // Returns the latest position of the game.
-  const Position& Last() const { return positions_.back(); }
+  const Position& Last() const {
+    return positions_.empty() ? (*prefix_)[prefix_size_ - 1]
+                              : positions_.back();
+  }
 
   // N-th position of the game, 0-based.
-  const Position& GetPositionAt(int idx) const { return positions_[idx]; }
+  const Position& GetPositionAt(int idx) const {
+    return idx < prefix_size_ ? (*prefix_)[idx]
+                              : positions_[idx - prefix_size_];
+  }
 
   // Trims position to a given size.
   void Trim(int size) {
-    positions_.erase(positions_.begin() + size, positions_.end());
+    if (size < prefix_size_) {
+      prefix_size_ = size;
+      positions_.clear();
+    } else {
+      positions_.erase(positions_.begin() + (size - prefix_size_),
+                       positions_.end());
+    }
   }
 
   // Can be used to reduce allocation cost while performing a sequence of moves
   // in succession.
-  void Reserve(int size) { positions_.reserve(size); }
+  void Reserve(int size) {
+    if (size > prefix_size_) positions_.reserve(size - prefix_size_);
+  }
 
   // Number of positions in history.
-  int GetLength() const { return positions_.size(); }
+  int GetLength() const { return prefix_size_ + positions_.size(); }
 
   // Resets the position to a given state.
   void Reset(const ChessBoard& board, int rule50_ply, int game_ply);
@@ -133,7 +167,13 @@ class PositionHistory {
   void Append(Move m);
 
   // Pops last move from history.
-  void Pop() { positions_.pop_back(); }
+  void Pop() {
+    if (positions_.empty()) {
+      --prefix_size_;
+    } else {
+      positions_.pop_back();
+    }
+  }
 
   // Finds the endgame state (win/lose/draw/nothing) for the last position.
   GameResult ComputeGameResult() const;
@@ -141,7 +181,8 @@ class PositionHistory {
   // Returns whether next move is history should be black's.
   bool IsBlackToMove() const { return Last().IsBlackToMove(); }
 
-  // Builds a hash from last X positions.
+  // Builds a hash from last X positions. Uses the rolling hashes of the
+  // positions, so its cost doesn't grow with X.
   uint64_t HashLast(int positions) const;
 
   // Checks for any repetitions since the last time 50 move rule was reset.
@@ -149,7 +190,13 @@ class PositionHistory {
 
  private:
   int ComputeLastMoveRepetitions(int* cycle_length) const;
+  // Sets the rolling history hash of the last position.
+  void UpdateLastHistoryHash();
 
+  // Shared positions, of which the first prefix_size_ belong to this history.
+  std::shared_ptr<const std::vector<Position>> prefix_;
+  int prefix_size_ = 0;
+  // Positions following the prefix.
   std::vector<Position> positions_;
 };
 
@@ -161,6 +161,91 @@ TEST(PositionHistory, DidRepeatSinceLastZeroingMoveNeverRepeated) {
   EXPECT_FALSE(history.DidRepeatSinceLastZeroingMove());
 }
 
+TEST(PositionHistory, SharedCopyRepetitionsAcrossPrefix) {
+  ChessBoard board;
+  PositionHistory history;
+  board.SetFromFen("3b4/rp1r1k2/8/1RP2p1p/p1KP4/P3P2P/5P2/1R2B3 b - - 2 30");
+  history.Reset(board, 2, 30);
+  history.Append(Move("f7f8", true));
+  history.Append(Move("b1c1", false));
+  PositionHistory shared = history.SharedCopy();
+  history.Append(Move("f8f7", true));
+  history.Append(Move("c1b1", false));
+  shared.Append(Move("f8f7", true));
+  shared.Append(Move("c1b1", false));
+  EXPECT_EQ(shared.GetLength(), 5);
+  EXPECT_EQ(shared.Last().GetRepetitions(), 1);
+  EXPECT_TRUE(shared.DidRepeatSinceLastZeroingMove());
+  EXPECT_EQ(shared.HashLast(5), history.HashLast(5));
+
+  // Trimming into the prefix doesn't affect the other copies.
+  PositionHistory copy = shared;
+  copy.Trim(1);
+  copy.Append(Move("f7e7", true));
+  EXPECT_EQ(copy.GetLength(), 2);
+  EXPECT_EQ(shared.GetLength(), 5);
+  EXPECT_EQ(shared.GetPositionAt(1).GetBoard(),
+            history.GetPositionAt(1).GetBoard());
+  copy.Pop();
+  copy.Pop();
+  EXPECT_EQ(copy.GetLength(), 0);
+}
+
+namespace {
+// Checks that the incrementally updated hashes of all positions up to @depth
+// plies away match the ones of boards set up from scratch.
+void CheckIncrementalHashes(const Position& pos, int depth) {
+  EXPECT_EQ(pos.GetBoard().Hash(), ChessBoard(GetFen(pos)).Hash())
+      << GetFen(pos);
+  if (depth == 0) return;
+  for (auto move : pos.GetBoard().GenerateLegalMoves()) {
+    CheckIncrementalHashes(Position(pos, move), depth - 1);
+  }
+}
+}  // namespace
+
+TEST(Position, IncrementalHash) {
+  for (const char* fen :
+       {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"}) {
+    CheckIncrementalHashes(Position(ChessBoard(fen), 0, 0), 3);
+  }
+}
+
+TEST(Position, DerivedBoards) {
+  const ChessBoard board(ChessBoard::kStartposFen);
+  ChessBoard after_move = board;
+  after_move.ApplyMove(Move("e2e4", false));
+  const Position pos(Position(board, 0, 0), Move("e2e4", false));
+  EXPECT_TRUE(pos.IsBlackToMove());
+  EXPECT_EQ(pos.GetThemBoard(), after_move);
+  EXPECT_EQ(pos.GetThemBoard().Hash(), after_move.Hash());
+  EXPECT_EQ(pos.GetWhiteBoard(), after_move);
+  after_move.Mirror();
+  EXPECT_EQ(pos.GetBoard(), after_move);
+}
+
+TEST(PositionHistory, HashLastDependsOnLastPositionsOnly) {
+  ChessBoard board;
+  PositionHistory history;
+  board.SetFromFen(ChessBoard::kStartposFen);
+  history.Reset(board, 0, 0);
+  history.Append(Move("g1f3", false));
+  history.Append(Move("g8f6", true));
+
+  PositionHistory other;
+  board.SetFromFen(
+      "rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq - 1 1");
+  other.Reset(board, 1, 1);
+  other.Append(Move("g8f6", true));
+
+  EXPECT_EQ(history.HashLast(1), other.HashLast(1));
+  EXPECT_EQ(history.HashLast(2), other.HashLast(2));
+  EXPECT_NE(history.HashLast(3), other.HashLast(3));
+  EXPECT_NE(history.HashLast(1), history.HashLast(2));
+}
+
 }  // namespace lczero
 
 int main(int argc, char** argv) {
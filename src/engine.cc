@@ -51,6 +51,24 @@ const OptionId kSyzygyTablebaseId{
     "List of Syzygy tablebase directories, list entries separated by system "
     "separator (\";\" for Windows, \":\" for Linux).",
     's'};
+const OptionId kSyzygyWarmupId{
+    "syzygy-warmup", "SyzygyWarmup",
+    "Read all Syzygy tables with up to that many pieces into memory in the "
+    "background when they are loaded. 0 to disable."};
+const OptionId kSyzygyPrefetchId{
+    "syzygy-prefetch", "SyzygyPrefetch",
+    "Read the Syzygy tables reachable from the root position into memory in "
+    "the background once it has at most that many pieces more than the "
+    "largest tables. -1 to disable."};
+const OptionId kSyzygyMapPopulateId{
+    "syzygy-map-populate", "SyzygyMapPopulate",
+    "Read every Syzygy table into memory in full when it's first used, using "
+    "huge pages where supported, as long as it fits in free memory."};
+const OptionId kCascadeWeightsId{
+    "cascade-weights", "CascadeWeightsFile",
+    "Path from which to load a small network evaluating new leaves first, see "
+    "CascadeVisits. It uses the backend and backend options of the main "
+    "network. Empty to disable."};
 const OptionId kPonderId{"ponder", "Ponder",
                          "This option is ignored. Here to please chess GUIs."};
 const OptionId kUciChess960{
@@ -100,6 +118,10 @@ void EngineController::PopulateOptions(OptionsParser* options) {
   SearchParams::Populate(options);
 
   options->Add<StringOption>(kSyzygyTablebaseId);
+  options->Add<IntOption>(kSyzygyWarmupId, 0, 7) = 0;
+  options->Add<IntOption>(kSyzygyPrefetchId, -1, 32) = -1;
+  options->Add<BoolOption>(kSyzygyMapPopulateId) = false;
+  options->Add<StringOption>(kCascadeWeightsId);
   // Add "Ponder" option to signal to GUIs that we support pondering.
   // This option is currently not used by lc0 in any way.
   options->Add<BoolOption>(kPonderId) = true;
@@ -128,13 +150,18 @@ void EngineController::UpdateFromUciOptions() {
   std::string tb_paths = options_.Get<std::string>(kSyzygyTablebaseId);
   if (!tb_paths.empty() && tb_paths != tb_paths_) {
     syzygy_tb_ = std::make_unique<SyzygyTablebase>();
+    syzygy_tb_->set_map_populate(options_.Get<bool>(kSyzygyMapPopulateId));
     CERR << "Loading Syzygy tablebases from " << tb_paths;
     if (!syzygy_tb_->init(tb_paths)) {
       CERR << "Failed to load Syzygy tablebases!";
       syzygy_tb_ = nullptr;
     } else {
       tb_paths_ = tb_paths;
+      const int warmup = options_.Get<int>(kSyzygyWarmupId);
+      if (warmup > 0) syzygy_tb_->prefetch_tables(warmup);
     }
+  } else if (syzygy_tb_) {
+    syzygy_tb_->set_map_populate(options_.Get<bool>(kSyzygyMapPopulateId));
   }
 
   // Network.
@@ -145,6 +172,19 @@ void EngineController::UpdateFromUciOptions() {
     network_configuration_ = network_configuration;
   }
 
+  // Cascade network.
+  auto cascade_configuration = network_configuration;
+  cascade_configuration.weights_path =
+      options_.Get<std::string>(kCascadeWeightsId);
+  if (cascade_configuration.weights_path.empty()) {
+    cascade_network_.reset();
+    cascade_configuration_ = {};
+  } else if (cascade_configuration_ != cascade_configuration) {
+    cascade_network_ = NetworkFactory::LoadNetwork(
+        options_, cascade_configuration.weights_path);
+    cascade_configuration_ = cascade_configuration;
+  }
+
   // Cache size.
   cache_.SetCapacity(options_.Get<int>(kNNCacheSizeId));
 
@@ -292,12 +332,17 @@ void EngineController::Go(const GoParams& params) {
     responder = std::make_unique<MovesLeftResponseFilter>(std::move(responder));
   }
 
+  const int tb_prefetch = options_.Get<int>(kSyzygyPrefetchId);
+  if (syzygy_tb_ && tb_prefetch >= 0) {
+    syzygy_tb_->prefetch_reachable(tree_->HeadPosition(), tb_prefetch);
+  }
+
   auto stopper = time_manager_->GetStopper(params, *tree_.get());
   search_ = std::make_unique<Search>(
       *tree_, network_.get(), std::move(responder),
       StringsToMovelist(params.searchmoves, tree_->HeadPosition().GetBoard()),
       *move_start_time_, std::move(stopper), params.infinite || params.ponder,
-      options_, &cache_, syzygy_tb_.get());
+      options_, &cache_, syzygy_tb_.get(), cascade_network_.get());
 
   LOGFILE << "Timer started at "
           << FormatTime(SteadyClockToSystemClock(*move_start_time_));
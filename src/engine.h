@@ -97,12 +97,14 @@ class EngineController {
   std::unique_ptr<NodeTree> tree_;
   std::unique_ptr<SyzygyTablebase> syzygy_tb_;
   std::unique_ptr<Network> network_;
+  std::unique_ptr<Network> cascade_network_;
   NNCache cache_;
 
   // Store current TB and network settings to track when they change so that
   // they are reloaded.
   std::string tb_paths_;
   NetworkFactory::BackendConfiguration network_configuration_;
+  NetworkFactory::BackendConfiguration cascade_configuration_;
 
   // The current position as given with SetPosition. For normal (ie. non-ponder)
   // search, the tree is set up with this position, however, during ponder we
@@ -27,6 +27,7 @@
 
 #include "benchmark/backendbench.h"
 #include "benchmark/benchmark.h"
+#include "benchmark/perft.h"
 #include "chess/board.h"
 #include "engine.h"
 #include "lc0ctl/describenet.h"
@@ -59,6 +60,7 @@ int main(int argc, const char** argv) {
     CommandLine::RegisterMode("benchmark", "Quick benchmark");
     CommandLine::RegisterMode("backendbench",
                               "Quick benchmark of backend only");
+    CommandLine::RegisterMode("perft", "Benchmark of move generation only");
     CommandLine::RegisterMode("leela2onnx", "Convert Leela network to ONNX.");
     CommandLine::RegisterMode("onnx2leela",
                               "Convert ONNX network to Leela net.");
@@ -77,6 +79,10 @@ int main(int argc, const char** argv) {
       // Backend Benchmark mode.
       BackendBenchmark benchmark;
       benchmark.Run();
+    } else if (CommandLine::ConsumeCommand("perft")) {
+      // Move generation benchmark mode.
+      Perft perft;
+      perft.Run();
     } else if (CommandLine::ConsumeCommand("leela2onnx")) {
       lczero::ConvertLeelaToOnnx();
     } else if (CommandLine::ConsumeCommand("onnx2leela")) {
@@ -34,6 +34,7 @@
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <vector>
 
 #include "neural/encoder.h"
 #include "neural/network.h"
@@ -299,6 +300,28 @@ void Node::SortEdges() {
             [](const Edge& a, const Edge& b) { return a.p_ > b.p_; });
 }
 
+void Node::SortUnvisitedEdges() {
+  assert(edges_);
+  // Edges are tied to child nodes by position, so only edges without a node,
+  // or with one that holds no state yet, can be moved.
+  std::vector<int> positions;
+  std::vector<Edge> unvisited;
+  for (auto& edge : Edges()) {
+    const Node* node = edge.node();
+    if (node && (node->GetNStarted() > 0 || node->HasChildren() ||
+                 node->IsTerminal())) {
+      continue;
+    }
+    positions.push_back(edge.edge() - edges_.get());
+    unvisited.push_back(*edge.edge());
+  }
+  std::stable_sort(unvisited.begin(), unvisited.end(),
+                   [](const Edge& a, const Edge& b) { return a.p_ > b.p_; });
+  for (size_t i = 0; i < positions.size(); i++) {
+    edges_[positions[i]] = unvisited[i];
+  }
+}
+
 void Node::MakeTerminal(GameResult result, float plies_left, Terminal type) {
   if (type != Terminal::TwoFold) SetBounds(result, result);
   terminal_type_ = type;
@@ -318,6 +341,44 @@ void Node::MakeTerminal(GameResult result, float plies_left, Terminal type) {
   }
 }
 
+namespace {
+// Bits of the packed cascade values, and the steps per unit they are stored
+// in. Value is shifted by 1 to be non-negative.
+constexpr int kCascadeVBits = 11;
+constexpr int kCascadeDBits = 10;
+constexpr int kCascadeMBits = 11;
+constexpr float kCascadeVScale = ((1 << kCascadeVBits) - 1) / 2.0f;
+constexpr float kCascadeDScale = (1 << kCascadeDBits) - 1;
+constexpr float kCascadeMScale = 4.0f;
+
+uint32_t PackCascadeValue(float value, float scale, int bits, int shift) {
+  const float max = (1 << bits) - 1;
+  return static_cast<uint32_t>(std::clamp(std::round(value * scale), 0.0f, max))
+         << shift;
+}
+
+float UnpackCascadeValue(uint32_t packed, float scale, int bits, int shift) {
+  return ((packed >> shift) & ((1u << bits) - 1)) / scale;
+}
+}  // namespace
+
+void Node::SetCascadeValues(float v, float d, float m) {
+  cascade_values_ =
+      PackCascadeValue(v + 1.0f, kCascadeVScale, kCascadeVBits, 0) |
+      PackCascadeValue(d, kCascadeDScale, kCascadeDBits, kCascadeVBits) |
+      PackCascadeValue(m, kCascadeMScale, kCascadeMBits,
+                       kCascadeVBits + kCascadeDBits);
+}
+
+void Node::GetCascadeValues(float* v, float* d, float* m) const {
+  *v = UnpackCascadeValue(cascade_values_, kCascadeVScale, kCascadeVBits, 0) -
+       1.0f;
+  *d = UnpackCascadeValue(cascade_values_, kCascadeDScale, kCascadeDBits,
+                          kCascadeVBits);
+  *m = UnpackCascadeValue(cascade_values_, kCascadeMScale, kCascadeMBits,
+                          kCascadeVBits + kCascadeDBits);
+}
+
 void Node::MakeNotTerminal() {
   terminal_type_ = Terminal::NonTerminal;
   n_ = 0;
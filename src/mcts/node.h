@@ -137,7 +137,8 @@ class Node {
         terminal_type_(Terminal::NonTerminal),
         lower_bound_(GameResult::BLACK_WON),
         upper_bound_(GameResult::WHITE_WON),
-        solid_children_(false) {}
+        solid_children_(false),
+        cascade_eval_(false) {}
 
   // We have a custom destructor, but its behavior does not need to be emulated
   // during move operations so default is fine.
@@ -178,6 +179,14 @@ class Node {
   typedef std::pair<GameResult, GameResult> Bounds;
   Bounds GetBounds() const { return {lower_bound_, upper_bound_}; }
   uint8_t GetNumEdges() const { return num_edges_; }
+  // Whether the value and policy of the node come from the cascade network.
+  bool IsCascadeEval() const { return cascade_eval_; }
+  void SetCascadeEval(bool cascade_eval) { cascade_eval_ = cascade_eval; }
+  // The value, draw and moves left the cascade network gave the node, kept to
+  // be replaced by the main network's later. Stored at reduced precision: about
+  // 1e-3 for value and draw, a quarter ply (up to 511) for moves left.
+  void SetCascadeValues(float v, float d, float m);
+  void GetCascadeValues(float* v, float* d, float* m) const;
 
   // Output must point to at least max_needed floats.
   void CopyPolicy(int max_needed, float* output) const {
@@ -254,6 +263,9 @@ class Node {
   bool MakeSolid();
 
   void SortEdges();
+  // Like SortEdges(), but for a node which may have children: only the edges
+  // without visits are sorted, among the positions they occupy.
+  void SortUnvisitedEdges();
 
   // Index in parent edges - useful for correlated ordering.
   uint16_t Index() const { return index_; }
@@ -310,6 +322,9 @@ class Node {
   // but not finished). This value is added to n during selection which node
   // to pick in MCTS, and also when selecting the best move.
   uint32_t n_in_flight_ = 0;
+  // The cascade network's eval, see SetCascadeValues(). Fits in what would
+  // otherwise be padding.
+  uint32_t cascade_values_ = 0;
 
   // 2 byte fields.
   // Index of this node is parent's edge list.
@@ -327,6 +342,8 @@ class Node {
   GameResult upper_bound_ : 2;
   // Whether the child_ is actually an array of equal length to edges.
   bool solid_children_ : 1;
+  // Whether the node was evaluated by the cascade network.
+  bool cascade_eval_ : 1;
 
   // TODO(mooskagh) Unfriend NodeTree.
   friend class NodeTree;
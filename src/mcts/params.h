@@ -88,6 +88,7 @@ class SearchParams {
   bool GetOutOfOrderEval() const { return kOutOfOrderEval; }
   bool GetStickyEndgames() const { return kStickyEndgames; }
   bool GetSyzygyFastPlay() const { return kSyzygyFastPlay; }
+  int GetSyzygyProbeThreads() const { return kSyzygyProbeThreads; }
   int GetMultiPv() const { return options_.Get<int>(kMultiPvId); }
   bool GetPerPvCounters() const { return options_.Get<bool>(kPerPvCountersId); }
   std::string GetScoreType() const {
@@ -111,6 +112,7 @@ class SearchParams {
   int GetMaxOutOfOrderEvals() const { return kMaxOutOfOrderEvals; }
   float GetNpsLimit() const { return kNpsLimit; }
   int GetSolidTreeThreshold() const { return kSolidTreeThreshold; }
+  int GetCascadeVisits() const { return kCascadeVisits; }
 
   int GetTaskWorkersPerSearchWorker() const {
     return kTaskWorkersPerSearchWorker;
@@ -172,6 +174,7 @@ class SearchParams {
   static const OptionId kOutOfOrderEvalId;
   static const OptionId kStickyEndgamesId;
   static const OptionId kSyzygyFastPlayId;
+  static const OptionId kSyzygyProbeThreadsId;
   static const OptionId kMultiPvId;
   static const OptionId kPerPvCountersId;
   static const OptionId kScoreTypeId;
@@ -191,6 +194,7 @@ class SearchParams {
   static const OptionId kMaxOutOfOrderEvalsId;
   static const OptionId kNpsLimitId;
   static const OptionId kSolidTreeThresholdId;
+  static const OptionId kCascadeVisitsId;
   static const OptionId kTaskWorkersPerSearchWorkerId;
   static const OptionId kMinimumWorkSizeForProcessingId;
   static const OptionId kMinimumWorkSizeForPickingId;
@@ -230,6 +234,7 @@ class SearchParams {
   const bool kOutOfOrderEval;
   const bool kStickyEndgames;
   const bool kSyzygyFastPlay;
+  const int kSyzygyProbeThreads;
   const FillEmptyHistory kHistoryFill;
   const int kMiniBatchSize;
   const float kMovesLeftMaxEffect;
@@ -247,6 +252,7 @@ class SearchParams {
   const int kMaxOutOfOrderEvals;
   const float kNpsLimit;
   const int kSolidTreeThreshold;
+  const int kCascadeVisits;
   const int kTaskWorkersPerSearchWorker;
   const int kMinimumWorkSizeForProcessing;
   const int kMinimumWorkSizeForPicking;
@@ -151,14 +151,15 @@ Search::Search(const NodeTree& tree, Network* network,
                std::chrono::steady_clock::time_point start_time,
                std::unique_ptr<SearchStopper> stopper, bool infinite,
                const OptionsDict& options, NNCache* cache,
-               SyzygyTablebase* syzygy_tb)
+               SyzygyTablebase* syzygy_tb, Network* cascade_network)
     : ok_to_respond_bestmove_(!infinite),
       stopper_(std::move(stopper)),
       root_node_(tree.GetCurrentHead()),
       cache_(cache),
       syzygy_tb_(syzygy_tb),
-      played_history_(tree.GetPositionHistory()),
+      played_history_(tree.GetPositionHistory().SharedCopy()),
       network_(network),
+      cascade_network_(cascade_network),
       params_(options),
       searchmoves_(searchmoves),
       start_time_(start_time),
@@ -171,6 +172,16 @@ Search::Search(const NodeTree& tree, Network* network,
     pending_searchers_.store(params_.GetMaxConcurrentSearchers(),
                              std::memory_order_release);
   }
+  if (cascade_network_) {
+    // Both networks are fed the same inputs. Throws if they can't be.
+    NetworkCapabilities capabilities = network_->GetCapabilities();
+    capabilities.Merge(cascade_network_->GetCapabilities());
+  }
+  if (syzygy_tb_) {
+    for (int i = 0; i < params_.GetSyzygyProbeThreads(); i++) {
+      tb_probe_threads_.emplace_back([this]() { TablebaseProbeThread(); });
+    }
+  }
 }
 
 namespace {
@@ -475,6 +486,12 @@ std::vector<std::string> Search::GetVerboseStats(Node* node) const {
 
 void Search::SendMovesStats() const REQUIRES(counters_mutex_) {
   auto move_stats = GetVerboseStats(root_node_);
+  if (syzygy_tb_) {
+    move_stats.push_back(
+        "Syzygy WDL cache: " + std::to_string(syzygy_tb_->wdl_cache_hits()) +
+        " hits, " + std::to_string(syzygy_tb_->wdl_cache_misses()) +
+        " misses, " + std::to_string(tb_hits_.load()) + " tbhits");
+  }
 
   if (params_.GetVerboseStats()) {
     std::vector<ThinkingInfo> infos;
@@ -965,9 +982,47 @@ Search::~Search() {
     SharedMutex::Lock lock(nodes_mutex_);
     CancelSharedCollisions();
   }
+  {
+    Mutex::Lock lock(tb_probes_mutex_);
+    tb_probes_exiting_ = true;
+  }
+  tb_probes_added_.notify_all();
+  for (auto& thread : tb_probe_threads_) thread.join();
   LOGFILE << "Search destroyed.";
 }
 
+void Search::SubmitTablebaseProbes(
+    const std::vector<std::shared_ptr<TablebaseProbe>>& probes) {
+  {
+    Mutex::Lock lock(tb_probes_mutex_);
+    tb_probes_.insert(tb_probes_.end(), probes.begin(), probes.end());
+  }
+  tb_probes_added_.notify_all();
+}
+
+void Search::TablebaseProbeThread() {
+  while (true) {
+    std::shared_ptr<TablebaseProbe> probe;
+    {
+      Mutex::Lock lock(tb_probes_mutex_);
+      tb_probes_added_.wait(lock.get_raw(), [&]() {
+        return tb_probes_exiting_ || !tb_probes_.empty();
+      });
+      // The search threads have all exited, so nothing is waiting.
+      if (tb_probes_.empty()) return;
+      probe = std::move(tb_probes_.front());
+      tb_probes_.pop_front();
+    }
+    probe->wdl = syzygy_tb_->probe_wdl(probe->position, &probe->state);
+    {
+      // Under the lock, so that a search thread can't miss the notification.
+      Mutex::Lock lock(tb_probes_mutex_);
+      probe->done.store(true, std::memory_order_release);
+    }
+    tb_probes_done_.notify_all();
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // SearchWorker
 //////////////////////////////////////////////////////////////////////////////
@@ -1079,6 +1134,9 @@ void SearchWorker::ExecuteOneIteration() {
   // 2b. Collect collisions.
   CollectCollisions();
 
+  // 2c. Add cascade upgrades.
+  AddCascadeUpgrades();
+
   // 3. Prefetch into cache.
   MaybePrefetchIntoCache();
 
@@ -1090,6 +1148,9 @@ void SearchWorker::ExecuteOneIteration() {
   RunNNComputation();
   search_->backend_waiting_counter_.fetch_add(-1, std::memory_order_relaxed);
 
+  // 4b. Resolve the tablebase probes done meanwhile.
+  ResolveTablebaseProbes(true);
+
   // 5. Retrieve NN computations (and terminal values) into nodes.
   FetchMinibatchResults();
 
@@ -1127,6 +1188,12 @@ void SearchWorker::InitializeIteration(
   computation_ = std::make_unique<CachingComputation>(std::move(computation),
                                                       search_->cache_);
   computation_->Reserve(params_.GetMiniBatchSize());
+  cascade_computation_.reset();
+  if (search_->cascade_network_) {
+    cascade_computation_ = std::make_unique<CachingComputation>(
+        search_->cascade_network_->NewComputation(), search_->cache_, true);
+    cascade_computation_->Reserve(params_.GetMiniBatchSize());
+  }
   minibatch_.clear();
   minibatch_.reserve(2 * params_.GetMiniBatchSize());
 }
@@ -1181,8 +1248,10 @@ void SearchWorker::GatherMinibatch() {
   // that search can exit.
   while (minibatch_size < params_.GetMiniBatchSize() &&
          number_out_of_order_ < params_.GetMaxOutOfOrderEvals()) {
+    minibatch_size -= ResolveTablebaseProbes(false);
+
     // If there's something to process without touching slow neural net, do it.
-    if (minibatch_size > 0 && computation_->GetCacheMisses() == 0) return;
+    if (minibatch_size > 0 && GetCacheMisses() == 0) return;
 
     // If there is backend work to be done, and the backend is idle - exit
     // immediately.
@@ -1191,7 +1260,7 @@ void SearchWorker::GatherMinibatch() {
     // be keeping the backend busy. Which would mean that threads=1 has a
     // massive nps drop.
     if (thread_count > 1 && minibatch_size > 0 &&
-        computation_->GetCacheMisses() > params_.GetIdlingMinimumWork() &&
+        GetCacheMisses() > params_.GetIdlingMinimumWork() &&
         thread_count - search_->backend_waiting_counter_.load(
                            std::memory_order_relaxed) >
             params_.GetThreadIdlingThreshold()) {
@@ -1249,6 +1318,7 @@ void SearchWorker::GatherMinibatch() {
     if (needs_wait) {
       WaitForTasks();
     }
+    SubmitTablebaseProbes(new_start);
     bool some_ooo = false;
     for (int i = static_cast<int>(minibatch_.size()) - 1; i >= new_start; i--) {
       if (minibatch_[i].ooo_completed) {
@@ -1285,14 +1355,17 @@ void SearchWorker::GatherMinibatch() {
       // There are no OOO though.
       // Also terminals when OOO is disabled.
       if (!minibatch_[i].nn_queried) continue;
+      auto* computation = minibatch_[i].use_cascade
+                              ? cascade_computation_.get()
+                              : computation_.get();
       if (minibatch_[i].is_cache_hit) {
         // Since minibatch_[i] holds cache lock, this is guaranteed to succeed.
-        computation_->AddInputByHash(minibatch_[i].hash,
-                                     std::move(minibatch_[i].lock));
+        computation->AddInputByHash(minibatch_[i].hash,
+                                    std::move(minibatch_[i].lock));
       } else {
-        computation_->AddInput(minibatch_[i].hash,
-                               std::move(minibatch_[i].input_planes),
-                               std::move(minibatch_[i].probabilities_to_cache));
+        computation->AddInput(minibatch_[i].hash,
+                              std::move(minibatch_[i].input_planes),
+                              std::move(minibatch_[i].probabilities_to_cache));
       }
     }
 
@@ -1336,13 +1409,28 @@ void SearchWorker::ProcessPickedTask(int start_idx, int end_idx,
     // of the game), it means that we already visited this node before.
     if (picked_node.IsExtendable()) {
       // Node was never visited, extend it.
-      ExtendNode(node, picked_node.depth, picked_node.moves_to_visit, &history);
+      ExtendNode(node, picked_node.depth, picked_node.moves_to_visit, &history,
+                 search_->tb_probe_threads_.empty() ? nullptr
+                                                    : &picked_node.tb_probe);
+      // Extended once the probe is done.
+      if (picked_node.tb_probe) continue;
       if (!node->IsTerminal()) {
         picked_node.nn_queried = true;
         const auto hash = history.HashLast(params_.GetCacheHistoryLength() + 1);
         picked_node.hash = hash;
+        // New leaves below the root's children go to the cascade network.
+        picked_node.use_cascade =
+            search_->cascade_network_ && picked_node.moves_to_visit.size() > 1;
         picked_node.lock = NNCacheLock(search_->cache_, hash);
+        if (picked_node.lock && picked_node.lock->cascade &&
+            !picked_node.use_cascade) {
+          picked_node.lock = NNCacheLock();
+        }
         picked_node.is_cache_hit = picked_node.lock;
+        picked_node.cascade_eval = picked_node.is_cache_hit
+                                       ? picked_node.lock->cascade
+                                       : picked_node.use_cascade;
+        node->SetCascadeEval(picked_node.cascade_eval);
         if (!picked_node.is_cache_hit) {
           int transform;
           picked_node.input_planes = EncodePositionForNN(
@@ -1804,9 +1892,10 @@ void SearchWorker::PickNodesToExtendTask(
   }
 }
 
-void SearchWorker::ExtendNode(Node* node, int depth,
-                              const std::vector<Move>& moves_to_node,
-                              PositionHistory* history) {
+void SearchWorker::ExtendNode(
+    Node* node, int depth, const std::vector<Move>& moves_to_node,
+    PositionHistory* history,
+    std::shared_ptr<Search::TablebaseProbe>* tb_probe) {
   // Initialize position sequence with pre-move position.
   history->Trim(search_->played_history_.GetLength());
   for (size_t i = 0; i < moves_to_node.size(); i++) {
@@ -1866,8 +1955,16 @@ void SearchWorker::ExtendNode(Node* node, int depth,
         (board.ours() | board.theirs()).count() <=
             search_->syzygy_tb_->max_cardinality()) {
       ProbeState state;
-      const WDLScore wdl =
-          search_->syzygy_tb_->probe_wdl(history->Last(), &state);
+      WDLScore wdl;
+      if (tb_probe && !search_->syzygy_tb_->probe_wdl_cached(history->Last(),
+                                                            &wdl, &state)) {
+        // It may have to read from disk, leave it to the probe threads.
+        *tb_probe = std::make_shared<Search::TablebaseProbe>(history->Last());
+        return;
+      }
+      if (!tb_probe) {
+        wdl = search_->syzygy_tb_->probe_wdl(history->Last(), &state);
+      }
       // Only fail state means the WDL is wrong, probe_wdl may produce correct
       // result with a stat other than OK.
       if (state != FAIL) {
@@ -1881,17 +1978,7 @@ void SearchWorker::ExtendNode(Node* node, int depth,
             m = std::max(0.0f, parent->GetM() - 1.0f);
           }
         }
-        // If the colors seem backwards, check the checkmate check above.
-        if (wdl == WDL_WIN) {
-          node->MakeTerminal(GameResult::BLACK_WON, m,
-                             Node::Terminal::Tablebase);
-        } else if (wdl == WDL_LOSS) {
-          node->MakeTerminal(GameResult::WHITE_WON, m,
-                             Node::Terminal::Tablebase);
-        } else {  // Cursed wins and blessed losses count as draws.
-          node->MakeTerminal(GameResult::DRAW, m, Node::Terminal::Tablebase);
-        }
-        search_->tb_hits_.fetch_add(1, std::memory_order_acq_rel);
+        MakeTablebaseTerminal(node, wdl, m);
         return;
       }
     }
@@ -1901,6 +1988,80 @@ void SearchWorker::ExtendNode(Node* node, int depth,
   node->CreateEdges(legal_moves);
 }
 
+void SearchWorker::MakeTablebaseTerminal(Node* node, WDLScore wdl, float m) {
+  // If the colors seem backwards, check the checkmate check in ExtendNode.
+  if (wdl == WDL_WIN) {
+    node->MakeTerminal(GameResult::BLACK_WON, m, Node::Terminal::Tablebase);
+  } else if (wdl == WDL_LOSS) {
+    node->MakeTerminal(GameResult::WHITE_WON, m, Node::Terminal::Tablebase);
+  } else {  // Cursed wins and blessed losses count as draws.
+    node->MakeTerminal(GameResult::DRAW, m, Node::Terminal::Tablebase);
+  }
+  search_->tb_hits_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void SearchWorker::SubmitTablebaseProbes(int start_idx) {
+  std::vector<std::shared_ptr<Search::TablebaseProbe>> probes;
+  for (size_t i = start_idx; i < minibatch_.size(); i++) {
+    if (minibatch_[i].tb_probe) probes.push_back(minibatch_[i].tb_probe);
+  }
+  if (probes.empty()) return;
+  pending_tb_probes_ += probes.size();
+  search_->SubmitTablebaseProbes(probes);
+}
+
+int SearchWorker::ResolveTablebaseProbes(bool wait) {
+  if (pending_tb_probes_ == 0) return 0;
+  auto is_done = [](const NodeToProcess& picked_node) {
+    return picked_node.tb_probe &&
+           picked_node.tb_probe->done.load(std::memory_order_acquire);
+  };
+  if (wait) {
+    Mutex::Lock lock(search_->tb_probes_mutex_);
+    search_->tb_probes_done_.wait(lock.get_raw(), [&]() {
+      for (const auto& picked_node : minibatch_) {
+        if (picked_node.tb_probe && !is_done(picked_node)) return false;
+      }
+      return true;
+    });
+  }
+  if (std::none_of(minibatch_.begin(), minibatch_.end(), is_done)) return 0;
+  int removed = 0;
+  SharedMutex::Lock lock(search_->nodes_mutex_);
+  for (int i = static_cast<int>(minibatch_.size()) - 1; i >= 0; i--) {
+    auto& picked_node = minibatch_[i];
+    if (!is_done(picked_node)) continue;
+    const auto probe = std::move(picked_node.tb_probe);
+    --pending_tb_probes_;
+    Node* node = picked_node.node;
+    if (probe->state == FAIL) {
+      // Give the visit up. The node is picked again later, and then probed
+      // inline as the result is in the WDL cache now.
+      for (; node != search_->root_node_->GetParent();
+           node = node->GetParent()) {
+        node->CancelScoreUpdate(picked_node.multivisit);
+      }
+      minibatch_.erase(minibatch_.begin() + i);
+      ++removed;
+      continue;
+    }
+    // Same as in ExtendNode(), the parent is locked above already.
+    MakeTablebaseTerminal(
+        node, probe->wdl,
+        node->GetParent() ? std::max(0.0f, node->GetParent()->GetM() - 1.0f)
+                          : 0.0f);
+    if (!wait && params_.GetOutOfOrderEval()) {
+      // Resolve it like the other out of order evals during gathering.
+      FetchSingleNodeResult(&picked_node, picked_node, 0);
+      DoBackupUpdateSingleNode(picked_node);
+      minibatch_.erase(minibatch_.begin() + i);
+      ++removed;
+      ++number_out_of_order_;
+    }
+  }
+  return removed;
+}
+
 // Returns whether node was already in cache.
 bool SearchWorker::AddNodeToComputation(Node* node) {
   const auto hash = history_.HashLast(params_.GetCacheHistoryLength() + 1);
@@ -1921,11 +2082,9 @@ bool SearchWorker::AddNodeToComputation(Node* node) {
       moves.emplace_back(edge.GetMove().as_nn_index(transform));
     }
   } else {
-    // Cache pseudolegal moves. A bit of a waste, but faster.
-    const auto& pseudolegal_moves =
-        history_.Last().GetBoard().GeneratePseudolegalMoves();
-    moves.reserve(pseudolegal_moves.size());
-    for (auto iter = pseudolegal_moves.begin(), end = pseudolegal_moves.end();
+    const auto& legal_moves = history_.Last().GetBoard().GenerateLegalMoves();
+    moves.reserve(legal_moves.size());
+    for (auto iter = legal_moves.begin(), end = legal_moves.end();
          iter != end; ++iter) {
       moves.emplace_back(iter->as_nn_index(transform));
     }
@@ -1947,6 +2106,56 @@ void SearchWorker::CollectCollisions() {
   }
 }
 
+// 2c. Add cascade upgrades.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~
+void SearchWorker::AddCascadeUpgrades() {
+  cascade_upgrades_.clear();
+  if (scheduled_cascade_upgrades_.empty()) return;
+  cascade_upgrades_.swap(scheduled_cascade_upgrades_);
+
+  SharedMutex::SharedLock lock(search_->nodes_mutex_);
+  for (auto& upgrade : cascade_upgrades_) {
+    Node* node = FindNode(upgrade.moves);
+    if (!node || node->IsTerminal() || !node->HasChildren()) continue;
+    history_.Trim(search_->played_history_.GetLength());
+    for (const auto& move : upgrade.moves) history_.Append(move);
+    const auto hash = history_.HashLast(params_.GetCacheHistoryLength() + 1);
+    int transform;
+    auto planes =
+        EncodePositionForNN(search_->network_->GetCapabilities().input_format,
+                            history_, 8, params_.GetHistoryFill(), &transform);
+    upgrade.probability_transform = transform;
+    std::vector<uint16_t> moves;
+    moves.reserve(node->GetNumEdges());
+    for (const auto& edge : node->Edges()) {
+      moves.emplace_back(edge.GetMove().as_nn_index(transform));
+    }
+    upgrade.idx_in_computation = computation_->GetBatchSize();
+    computation_->AddInput(hash, std::move(planes), std::move(moves));
+  }
+}
+
+Node* SearchWorker::FindNode(const std::vector<Move>& moves) const {
+  Node* node = search_->root_node_;
+  for (const auto& move : moves) {
+    Node* child = nullptr;
+    for (auto& edge : node->Edges()) {
+      if (edge.GetMove() == move) {
+        child = edge.node();
+        break;
+      }
+    }
+    if (!child) return nullptr;
+    node = child;
+  }
+  return node;
+}
+
+int SearchWorker::GetCacheMisses() const {
+  return computation_->GetCacheMisses() +
+         (cascade_computation_ ? cascade_computation_->GetCacheMisses() : 0);
+}
+
 // 3. Prefetch into cache.
 // ~~~~~~~~~~~~~~~~~~~~~~~
 void SearchWorker::MaybePrefetchIntoCache() {
@@ -1954,6 +2163,9 @@ void SearchWorker::MaybePrefetchIntoCache() {
   // If there are requests to NN, but the batch is not full, try to prefetch
   // nodes which are likely useful in future.
   if (search_->stop_.load(std::memory_order_acquire)) return;
+  // Prefetched leaves would be evaluated by the main network, which is what the
+  // cascade network is there to avoid.
+  if (cascade_computation_) return;
   if (computation_->GetCacheMisses() > 0 &&
       computation_->GetCacheMisses() < params_.GetMaxPrefetchBatch()) {
     history_.Trim(search_->played_history_.GetLength());
@@ -2055,16 +2267,37 @@ int SearchWorker::PrefetchIntoCache(Node* node, int budget, bool is_odd_depth) {
 
 // 4. Run NN computation.
 // ~~~~~~~~~~~~~~~~~~~~~~
-void SearchWorker::RunNNComputation() { computation_->ComputeBlocking(); }
+void SearchWorker::RunNNComputation() {
+  // Results arriving after the search stops are wasted, so backends holding
+  // computations back to form larger batches shouldn't wait past that.
+  const auto deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(
+          latest_time_manager_hints_.GetEstimatedRemainingTimeMs());
+  computation_->SetDeadline(deadline);
+  if (cascade_computation_) {
+    cascade_computation_->SetDeadline(deadline);
+    cascade_computation_->ComputeBlocking();
+  }
+  computation_->ComputeBlocking();
+}
 
 // 5. Retrieve NN computations (and terminal values) into nodes.
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void SearchWorker::FetchMinibatchResults() {
   // Populate NN/cached results, or terminal results, into nodes.
   int idx_in_computation = 0;
+  int idx_in_cascade_computation = 0;
   for (auto& node_to_process : minibatch_) {
-    FetchSingleNodeResult(&node_to_process, *computation_, idx_in_computation);
-    if (node_to_process.nn_queried) ++idx_in_computation;
+    if (node_to_process.use_cascade) {
+      FetchSingleNodeResult(&node_to_process, *cascade_computation_,
+                            idx_in_cascade_computation);
+      if (node_to_process.nn_queried) ++idx_in_cascade_computation;
+    } else {
+      FetchSingleNodeResult(&node_to_process, *computation_,
+                            idx_in_computation);
+      if (node_to_process.nn_queried) ++idx_in_computation;
+    }
   }
 }
 
@@ -2087,7 +2320,27 @@ void SearchWorker::FetchSingleNodeResult(NodeToProcess* node_to_process,
   node_to_process->v = -computation.GetQVal(idx_in_computation);
   node_to_process->d = computation.GetDVal(idx_in_computation);
   node_to_process->m = computation.GetMVal(idx_in_computation);
+  // Kept to be replaced by the main network's eval later. The cache can't be
+  // relied on for it, as the entry is shared by transpositions and may be
+  // evicted.
+  if (node_to_process->cascade_eval) {
+    node->SetCascadeValues(node_to_process->v, node_to_process->d,
+                           node_to_process->m);
+  }
   // ...and secondly, the policy data.
+  SetPolicy(node, computation, idx_in_computation,
+            node_to_process->probability_transform);
+  // Add Dirichlet noise if enabled and at root.
+  if (params_.GetNoiseEpsilon() && node == search_->root_node_) {
+    ApplyDirichletNoise(node, params_.GetNoiseEpsilon(),
+                        params_.GetNoiseAlpha());
+  }
+  node->SortEdges();
+}
+
+template <typename Computation>
+void SearchWorker::SetPolicy(Node* node, const Computation& computation,
+                             int idx_in_computation, int transform) {
   // Calculate maximum first.
   float max_p = -std::numeric_limits<float>::infinity();
   // Intermediate array to store values when processing policy.
@@ -2095,9 +2348,8 @@ void SearchWorker::FetchSingleNodeResult(NodeToProcess* node_to_process,
   std::array<float, 256> intermediate;
   int counter = 0;
   for (auto& edge : node->Edges()) {
-    float p = computation.GetPVal(
-        idx_in_computation,
-        edge.GetMove().as_nn_index(node_to_process->probability_transform));
+    float p = computation.GetPVal(idx_in_computation,
+                                  edge.GetMove().as_nn_index(transform));
     intermediate[counter++] = p;
     max_p = std::max(max_p, p);
   }
@@ -2116,12 +2368,6 @@ void SearchWorker::FetchSingleNodeResult(NodeToProcess* node_to_process,
   for (auto& edge : node->Edges()) {
     edge.edge()->SetP(intermediate[counter++] * scale);
   }
-  // Add Dirichlet noise if enabled and at root.
-  if (params_.GetNoiseEpsilon() && node == search_->root_node_) {
-    ApplyDirichletNoise(node, params_.GetNoiseEpsilon(),
-                        params_.GetNoiseAlpha());
-  }
-  node->SortEdges();
 }
 
 // 6. Propagate the new nodes' information to all their parents in the tree.
@@ -2137,6 +2383,13 @@ void SearchWorker::DoBackupUpdate() {
       work_done = true;
     }
   }
+  if (!cascade_upgrades_.empty()) {
+    for (const auto& upgrade : cascade_upgrades_) ApplyCascadeUpgrade(upgrade);
+    cascade_upgrades_.clear();
+    // The values of root children may have changed.
+    search_->current_best_edge_ =
+        search_->GetBestChildNoTemperature(search_->root_node_, 0);
+  }
   if (!work_done) return;
   search_->CancelSharedCollisions();
   search_->total_batches_ += 1;
@@ -2178,6 +2431,7 @@ void SearchWorker::DoBackupUpdateSingleNode(
     if (n_to_fix > 0 && !n->IsTerminal()) {
       n->AdjustForTerminal(v_delta, d_delta, m_delta, n_to_fix);
     }
+    MaybeScheduleCascadeUpgrade(n, p);
     if (n->GetN() >= solid_threshold) {
       if (n->MakeSolid() && n == search_->root_node_) {
         // If we make the root solid, the current_best_edge_ becomes invalid and
@@ -2224,6 +2478,61 @@ void SearchWorker::DoBackupUpdateSingleNode(
   search_->max_depth_ = std::max(search_->max_depth_, node_to_process.depth);
 }
 
+void SearchWorker::MaybeScheduleCascadeUpgrade(Node* node, Node* parent)
+    REQUIRES(search_->nodes_mutex_) {
+  if (!node->IsCascadeEval()) return;
+  // The root and its children, the head of every principal variation, don't
+  // wait for the visit threshold (they can be cascade nodes of a reused tree).
+  if (static_cast<int>(node->GetN()) < params_.GetCascadeVisits() &&
+      node != search_->root_node_ && parent != search_->root_node_) {
+    return;
+  }
+  node->SetCascadeEval(false);
+  CascadeUpgrade upgrade;
+  for (Node* n = node; n != search_->root_node_; n = n->GetParent()) {
+    upgrade.moves.push_back(n->GetOwnEdge()->GetMove());
+  }
+  std::reverse(upgrade.moves.begin(), upgrade.moves.end());
+  if (node->IsTerminal()) return;
+  node->GetCascadeValues(&upgrade.v, &upgrade.d, &upgrade.m);
+  scheduled_cascade_upgrades_.push_back(std::move(upgrade));
+}
+
+void SearchWorker::ApplyCascadeUpgrade(const CascadeUpgrade& upgrade)
+    REQUIRES(search_->nodes_mutex_) {
+  if (upgrade.idx_in_computation < 0) return;
+  Node* node = FindNode(upgrade.moves);
+  if (!node || node->IsTerminal() || !node->HasChildren()) return;
+  const int idx = upgrade.idx_in_computation;
+  SetPolicy(node, *computation_, idx, upgrade.probability_transform);
+  // The root can be upgraded after tree reuse, and must keep its noise.
+  if (params_.GetNoiseEpsilon() && node == search_->root_node_) {
+    ApplyDirichletNoise(node, params_.GetNoiseEpsilon(),
+                        params_.GetNoiseAlpha());
+  }
+  node->SortUnvisitedEdges();
+
+  // Replace the cascade network's eval in the averages of the node and its
+  // ancestors, like AdjustForTerminal() does for nodes becoming terminal.
+  float v_delta = -computation_->GetQVal(idx) - upgrade.v;
+  const float d_delta = computation_->GetDVal(idx) - upgrade.d;
+  const float m_delta = computation_->GetMVal(idx) - upgrade.m;
+  for (Node* n = node; n != search_->root_node_->GetParent();
+       n = n->GetParent()) {
+    if (n->IsTerminal()) break;
+    n->AdjustForTerminal(v_delta, d_delta, m_delta, 1);
+    v_delta = -v_delta;
+  }
+}
+
+void SearchWorker::UnscheduleCascadeUpgrades() {
+  SharedMutex::Lock lock(search_->nodes_mutex_);
+  for (const auto& upgrade : scheduled_cascade_upgrades_) {
+    if (Node* node = FindNode(upgrade.moves)) node->SetCascadeEval(true);
+  }
+  scheduled_cascade_upgrades_.clear();
+}
+
 bool SearchWorker::MaybeSetBounds(Node* p, float m, int* n_to_fix,
                                   float* v_delta, float* d_delta,
                                   float* m_delta) const {
@@ -29,10 +29,12 @@
 
 #include <array>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <optional>
 #include <shared_mutex>
 #include <thread>
+#include <vector>
 
 #include "chess/callbacks.h"
 #include "chess/uciloop.h"
@@ -56,7 +58,7 @@ class Search {
          std::chrono::steady_clock::time_point start_time,
          std::unique_ptr<SearchStopper> stopper, bool infinite,
          const OptionsDict& options, NNCache* cache,
-         SyzygyTablebase* syzygy_tb);
+         SyzygyTablebase* syzygy_tb, Network* cascade_network = nullptr);
 
   ~Search();
 
@@ -141,6 +143,20 @@ class Search {
   // Ensure that all shared collisions are cancelled and clear them out.
   void CancelSharedCollisions();
 
+  // A WDL probe run by the probe threads, see SyzygyProbeThreads.
+  struct TablebaseProbe {
+    explicit TablebaseProbe(const Position& position) : position(position) {}
+    const Position position;
+    WDLScore wdl = WDL_DRAW;
+    ProbeState state = FAIL;
+    std::atomic<bool> done{false};
+  };
+  // Queues a batch of probes for the probe threads.
+  void SubmitTablebaseProbes(
+      const std::vector<std::shared_ptr<TablebaseProbe>>& probes);
+  // Function which runs in the probe threads.
+  void TablebaseProbeThread();
+
   mutable Mutex counters_mutex_ ACQUIRED_AFTER(nodes_mutex_);
   // Tells all threads to stop.
   std::atomic<bool> stop_{false};
@@ -165,10 +181,13 @@ class Search {
   Node* root_node_;
   NNCache* cache_;
   SyzygyTablebase* syzygy_tb_;
-  // Fixed positions which happened before the search.
-  const PositionHistory& played_history_;
+  // Fixed positions which happened before the search. They are shared by the
+  // copies the workers make, which only copy the positions they append.
+  const PositionHistory played_history_;
 
   Network* const network_;
+  // Optional small network evaluating new leaves first, see CascadeVisits.
+  Network* const cascade_network_;
   const SearchParams params_;
   const MoveList searchmoves_;
   const std::chrono::steady_clock::time_point start_time_;
@@ -200,6 +219,16 @@ class Search {
   std::vector<std::pair<Node*, int>> shared_collisions_
       GUARDED_BY(nodes_mutex_);
 
+  Mutex tb_probes_mutex_;
+  // Signals new probes to the probe threads.
+  std::condition_variable tb_probes_added_;
+  // Signals finished probes to the search threads.
+  std::condition_variable tb_probes_done_;
+  std::deque<std::shared_ptr<TablebaseProbe>> tb_probes_
+      GUARDED_BY(tb_probes_mutex_);
+  bool tb_probes_exiting_ GUARDED_BY(tb_probes_mutex_) = false;
+  std::vector<std::thread> tb_probe_threads_;
+
   std::unique_ptr<UciResponder> uci_responder_;
 
   friend class SearchWorker;
@@ -247,6 +276,8 @@ class SearchWorker {
       do {
         ExecuteOneIteration();
       } while (search_->IsSearchActive());
+      // Leave the nodes not upgraded yet to a later search on the same tree.
+      UnscheduleCascadeUpgrades();
     } catch (std::exception& e) {
       std::cerr << "Unhandled exception in worker thread: " << e.what()
                 << std::endl;
@@ -275,6 +306,10 @@ class SearchWorker {
   // 2b. Copy collisions into shared_collisions_.
   void CollectCollisions();
 
+  // 2c. Add nodes evaluated by the cascade network which became important to
+  // the main network's computation.
+  void AddCascadeUpgrades();
+
   // 3. Prefetch into cache.
   void MaybePrefetchIntoCache();
 
@@ -315,6 +350,10 @@ class SearchWorker {
     bool nn_queried = false;
     bool is_cache_hit = false;
     bool is_collision = false;
+    // Evaluated through the cascade network's computation.
+    bool use_cascade = false;
+    // The result comes from the cascade network (possibly through the cache).
+    bool cascade_eval = false;
     int probability_transform = 0;
 
     // Details only populated in the multigather path.
@@ -329,6 +368,9 @@ class SearchWorker {
     InputPlanes input_planes;
     mutable int last_idx = 0;
     bool ooo_completed = false;
+    // Pending tablebase probe of a node which is neither extended nor
+    // evaluated, see ResolveTablebaseProbes().
+    std::shared_ptr<Search::TablebaseProbe> tb_probe;
 
     static NodeToProcess Collision(Node* node, uint16_t depth,
                                    int collision_count) {
@@ -423,10 +465,30 @@ class SearchWorker {
         : task_type(kProcessing), start_idx(start_idx), end_idx(end_idx) {}
   };
 
+  // A node evaluated by the cascade network, to be evaluated again by the main
+  // one. It's found again from the root by @moves, as nodes may move in memory
+  // (see Node::MakeSolid()) before the result arrives.
+  struct CascadeUpgrade {
+    std::vector<Move> moves;
+    int idx_in_computation = -1;
+    int probability_transform = 0;
+    // The cascade network's eval, to take out of the tree.
+    float v = 0.0f;
+    float d = 0.0f;
+    float m = 0.0f;
+  };
+
   NodeToProcess PickNodeToExtend(int collision_limit);
   bool AddNodeToComputation(Node* node);
   int PrefetchIntoCache(Node* node, int budget, bool is_odd_depth);
   void DoBackupUpdateSingleNode(const NodeToProcess& node_to_process);
+  void MaybeScheduleCascadeUpgrade(Node* node, Node* parent);
+  void ApplyCascadeUpgrade(const CascadeUpgrade& upgrade);
+  void UnscheduleCascadeUpgrades();
+  // Returns the node reached from the root by @moves, or nullptr.
+  Node* FindNode(const std::vector<Move>& moves) const;
+  // Inputs of both computations not found in the cache.
+  int GetCacheMisses() const;
   // Returns whether a node's bounds were set based on its children.
   bool MaybeSetBounds(Node* p, float m, int* n_to_fix, float* v_delta,
                       float* d_delta, float* m_delta) const;
@@ -439,12 +501,27 @@ class SearchWorker {
   void EnsureNodeTwoFoldCorrectForDepth(Node* node, int depth);
   void ProcessPickedTask(int batch_start, int batch_end,
                          TaskWorkspace* workspace);
+  // If @tb_probe is not null, tablebase probes which miss the WDL cache are
+  // returned there instead of being done, leaving the node as it is.
   void ExtendNode(Node* node, int depth, const std::vector<Move>& moves_to_add,
-                  PositionHistory* history);
+                  PositionHistory* history,
+                  std::shared_ptr<Search::TablebaseProbe>* tb_probe = nullptr);
+  // Makes @node a tablebase terminal. @m is the moves left estimate.
+  void MakeTablebaseTerminal(Node* node, WDLScore wdl, float m);
+  // Hands the probes returned by ExtendNode() from @start_idx on in the
+  // minibatch to the probe threads.
+  void SubmitTablebaseProbes(int start_idx);
+  // Applies the finished probes, waiting for all of them if @wait is true.
+  // Returns the number of entries removed from the minibatch.
+  int ResolveTablebaseProbes(bool wait);
   template <typename Computation>
   void FetchSingleNodeResult(NodeToProcess* node_to_process,
                              const Computation& computation,
                              int idx_in_computation);
+  // Sets the priors of the edges of @node from the policy head output.
+  template <typename Computation>
+  void SetPolicy(Node* node, const Computation& computation,
+                 int idx_in_computation, int transform);
   void RunTasks(int tid);
   void ResetTasks();
   // Returns how many tasks there were.
@@ -454,9 +531,17 @@ class SearchWorker {
   // List of nodes to process.
   std::vector<NodeToProcess> minibatch_;
   std::unique_ptr<CachingComputation> computation_;
+  // Computation of the cascade network, if any.
+  std::unique_ptr<CachingComputation> cascade_computation_;
+  // Scheduled during backup, added to the computation of the next iteration.
+  std::vector<CascadeUpgrade> scheduled_cascade_upgrades_;
+  // Added to the computation of this iteration.
+  std::vector<CascadeUpgrade> cascade_upgrades_;
   // History is reset and extended by PickNodeToExtend().
   PositionHistory history_;
   int number_out_of_order_ = 0;
+  // Number of entries in the minibatch waiting for a tablebase probe.
+  int pending_tb_probes_ = 0;
   const SearchParams& params_;
   std::unique_ptr<Node> precached_node_;
   const bool moves_left_support_;
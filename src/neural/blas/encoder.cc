@@ -0,0 +1,186 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "neural/blas/encoder.h"
+
+#include <cmath>
+#include <vector>
+
+#include "neural/blas/blas.h"
+#include "neural/shared/activation.h"
+#include "utils/exception.h"
+
+#ifdef USE_ISPC
+#include "encoder_ispc.h"
+#endif
+
+#include <Eigen/Dense>
+
+namespace lczero {
+namespace {
+using RowMajorMatrix =
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ConstRowMajorMap =
+    Eigen::Map<const RowMajorMatrix, 0, Eigen::OuterStride<>>;
+using RowMajorMap = Eigen::Map<RowMajorMatrix, 0, Eigen::OuterStride<>>;
+}  // namespace
+
+void LayerNorm2DWithSkipConnection(const size_t batch_size,
+                                   const size_t channels, float* data,
+                                   const float* bias, const float* skip,
+                                   const float* gammas, const float* betas,
+                                   const float epsilon) {
+#ifndef USE_ISPC
+
+  for (size_t i = 0; i < batch_size; i++) {
+    float* row = data + i * channels;
+    const float* skip_row = skip + i * channels;
+
+    // Mean taken in dimension C.
+    float mean = 0;
+    for (size_t c = 0; c < channels; c++) {
+      row[c] += bias[c] + skip_row[c];
+      mean += row[c];
+    }
+    mean /= channels;
+
+    // Variance.
+    float var = 0;
+    for (size_t c = 0; c < channels; c++) {
+      auto diff = row[c] - mean;
+      var += diff * diff;
+    }
+    var /= channels;
+
+    // Norm.
+    const float den = 1.0f / std::sqrt(var + epsilon);
+    for (size_t c = 0; c < channels; c++) {
+      row[c] = betas[c] + gammas[c] * (row[c] - mean) * den;
+    }
+  }
+
+#else  // USE_ISPC
+
+  ispc::LayerNorm2DWithSkipConnection(batch_size, channels, data, bias, skip,
+                                      gammas, betas, epsilon);
+
+#endif  // USE_ISPC
+}
+
+void SoftmaxRows(const size_t rows, const size_t cols, float* data) {
+#ifndef USE_ISPC
+
+  for (size_t i = 0; i < rows; i++) {
+    SoftmaxActivation(cols, data + i * cols, data + i * cols);
+  }
+
+#else  // USE_ISPC
+
+  ispc::SoftmaxRows(rows, cols, data);
+
+#endif  // USE_ISPC
+}
+
+template <bool use_eigen>
+void BatchedMatMul(const size_t count, const size_t m, const size_t n,
+                   const size_t k, const float alpha, const float* a,
+                   const size_t lda, const size_t stride_a, const float* b,
+                   const size_t ldb, const size_t stride_b,
+                   const bool transpose_b, float* c, const size_t ldc,
+                   const size_t stride_c) {
+  if (use_eigen) {
+    for (size_t i = 0; i < count; i++) {
+      const auto A =
+          ConstRowMajorMap(a + i * stride_a, m, k, Eigen::OuterStride<>(lda));
+      auto C = RowMajorMap(c + i * stride_c, m, n, Eigen::OuterStride<>(ldc));
+      if (transpose_b) {
+        C.noalias() = alpha * A *
+                      ConstRowMajorMap(b + i * stride_b, n, k,
+                                       Eigen::OuterStride<>(ldb))
+                          .transpose();
+      } else {
+        C.noalias() = alpha * A *
+                      ConstRowMajorMap(b + i * stride_b, k, n,
+                                       Eigen::OuterStride<>(ldb));
+      }
+    }
+    return;
+  }
+#ifdef USE_MKL
+
+  CBLAS_TRANSPOSE transA = CblasNoTrans;
+  CBLAS_TRANSPOSE transB = transpose_b ? CblasTrans : CblasNoTrans;
+  MKL_INT m_array = m;
+  MKL_INT n_array = n;
+  MKL_INT k_array = k;
+  float alpha_array = alpha;
+  MKL_INT lda_array = lda;
+  MKL_INT ldb_array = ldb;
+  float beta_array = 0.0;
+  MKL_INT ldc_array = ldc;
+  MKL_INT groupSize = count;
+
+  std::vector<const float*> a_array(count);
+  std::vector<const float*> b_array(count);
+  std::vector<float*> c_array(count);
+  for (size_t i = 0; i < count; i++) {
+    a_array[i] = a + i * stride_a;
+    b_array[i] = b + i * stride_b;
+    c_array[i] = c + i * stride_c;
+  }
+
+  cblas_sgemm_batch(CblasRowMajor, &transA, &transB, &m_array, &n_array,
+                    &k_array, &alpha_array, a_array.data(), &lda_array,
+                    b_array.data(), &ldb_array, &beta_array, c_array.data(),
+                    &ldc_array, 1, &groupSize);
+
+#elif defined(USE_BLAS)
+
+  for (size_t i = 0; i < count; i++) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans,
+                transpose_b ? CblasTrans : CblasNoTrans, (int)m, (int)n,
+                (int)k, alpha, a + i * stride_a, (int)lda, b + i * stride_b,
+                (int)ldb, 0.0f, c + i * stride_c, (int)ldc);
+  }
+
+#else
+  // Should never get here.
+  throw Exception("Blas backend internal error");
+#endif
+}
+
+template void BatchedMatMul<true>(const size_t count, const size_t m,
+                                  const size_t n, const size_t k,
+                                  const float alpha, const float* a,
+                                  const size_t lda, const size_t stride_a,
+                                  const float* b, const size_t ldb,
+                                  const size_t stride_b, const bool transpose_b,
+                                  float* c, const size_t ldc,
+                                  const size_t stride_c);
+#ifdef USE_BLAS
+template void BatchedMatMul<false>(const size_t count, const size_t m,
+                                   const size_t n, const size_t k,
+                                   const float alpha, const float* a,
+                                   const size_t lda, const size_t stride_a,
+                                   const float* b, const size_t ldb,
+                                   const size_t stride_b,
+                                   const bool transpose_b, float* c,
+                                   const size_t ldc, const size_t stride_c);
+#endif
+
+}  // namespace lczero
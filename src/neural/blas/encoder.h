@@ -0,0 +1,49 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace lczero {
+
+// Adds @bias and @skip to every row of the batch_size x channels matrix @data
+// and applies layer normalization over the channels, in place.
+void LayerNorm2DWithSkipConnection(const size_t batch_size,
+                                   const size_t channels, float* data,
+                                   const float* bias, const float* skip,
+                                   const float* gammas, const float* betas,
+                                   const float epsilon);
+
+// Softmax over every row of the rows x cols matrix @data, in place.
+void SoftmaxRows(const size_t rows, const size_t cols, float* data);
+
+// Computes count independent row major products
+//   c[i] = alpha * a[i] x b[i]         (or b[i] transposed if @transpose_b)
+// where a[i] is m x k, the result is m x n and the matrices of consecutive
+// products are stride_a, stride_b and stride_c elements apart. A stride of 0
+// shares the operand between all products.
+template <bool use_eigen>
+void BatchedMatMul(const size_t count, const size_t m, const size_t n,
+                   const size_t k, const float alpha, const float* a,
+                   const size_t lda, const size_t stride_a, const float* b,
+                   const size_t ldb, const size_t stride_b,
+                   const bool transpose_b, float* c, const size_t ldc,
+                   const size_t stride_c);
+
+}  // namespace lczero
@@ -0,0 +1,109 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "neural/blas/expand_planes.h"
+
+#include "utils/cpu_features.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#include <immintrin.h>
+#define EXPAND_PLANES_X86
+#endif
+
+// Like the GEMM kernels, compiled for their ISA and picked at runtime.
+#if defined(__GNUC__)
+#define EXPAND_PLANES_TARGET(isa) __attribute__((target(isa)))
+#else
+#define EXPAND_PLANES_TARGET(isa)
+#endif
+
+namespace lczero {
+namespace {
+
+constexpr int kSquares = 64;
+
+using Kernel = void (*)(const InputPlanes& planes, float* output);
+
+void GenericExpand(const InputPlanes& planes, float* output) {
+  for (const InputPlane& plane : planes) {
+    const float value = plane.value;
+    for (int i = 0; i < kSquares; i++) {
+      *(output++) = (plane.mask & (uint64_t{1} << i)) != 0 ? value : 0.0f;
+    }
+  }
+}
+
+#ifdef EXPAND_PLANES_X86
+EXPAND_PLANES_TARGET("avx512f")
+void Avx512Expand(const InputPlanes& planes, float* output) {
+  for (const InputPlane& plane : planes) {
+    const __m512 value = _mm512_set1_ps(plane.value);
+    for (int i = 0; i < kSquares; i += 16) {
+      const auto bits = static_cast<__mmask16>(plane.mask >> i);
+      _mm512_storeu_ps(output + i, _mm512_maskz_mov_ps(bits, value));
+    }
+    output += kSquares;
+  }
+}
+
+EXPAND_PLANES_TARGET("avx2")
+void Avx2Expand(const InputPlanes& planes, float* output) {
+  // Lane j of a group of 8 squares tests bit j of the group's mask byte.
+  const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  for (const InputPlane& plane : planes) {
+    const __m256 value = _mm256_set1_ps(plane.value);
+    for (int i = 0; i < kSquares; i += 8) {
+      const __m256i bits = _mm256_and_si256(
+          _mm256_set1_epi32(static_cast<int>(plane.mask >> i)), lane_bits);
+      const __m256i set = _mm256_cmpeq_epi32(bits, lane_bits);
+      _mm256_storeu_ps(output + i,
+                       _mm256_and_ps(_mm256_castsi256_ps(set), value));
+    }
+    output += kSquares;
+  }
+}
+#endif
+
+struct KernelChoice {
+  Kernel kernel;
+  const char* name;
+};
+
+const KernelChoice& GetKernel() {
+  static const KernelChoice choice = []() -> KernelChoice {
+    const auto& features = GetCpuFeatures();
+#ifdef EXPAND_PLANES_X86
+    if (features.avx512f) return {Avx512Expand, "avx512"};
+    if (features.avx2) return {Avx2Expand, "avx2"};
+#endif
+    (void)features;
+    return {GenericExpand, "generic"};
+  }();
+  return choice;
+}
+
+}  // namespace
+
+void ExpandPlanes(const InputPlanes& planes, float* output) {
+  GetKernel().kernel(planes, output);
+}
+
+const char* ExpandPlanesKernelName() { return GetKernel().name; }
+
+}  // namespace lczero
@@ -0,0 +1,32 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "neural/network.h"
+
+namespace lczero {
+
+// Expands the input planes to 64 floats each, the plane's value on the squares
+// set in its mask and zero elsewhere.
+void ExpandPlanes(const InputPlanes& planes, float* output);
+
+// Name of the kernel ExpandPlanes() picked for this processor.
+const char* ExpandPlanesKernelName();
+
+}  // namespace lczero
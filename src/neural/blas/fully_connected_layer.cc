@@ -30,12 +30,16 @@ namespace lczero {
 namespace {
 void ApplyBias(size_t batch_size, const size_t output_size, const float* biases,
                const ActivationFunction activation, float* outputs) {
+  if (biases == nullptr) {
+    // Plain matrix multiplication, the bias is added later by the caller.
+    assert(activation == NONE);
+    return;
+  }
   for (size_t i = 0; i < batch_size; i++) {
     float* batch_outputs = outputs + i * output_size;
     Activate(output_size, batch_outputs, biases, batch_outputs, activation);
   }
 }
-}  // namespace
 
 template <typename T>
 using EigenVectorMap = Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, 1>>;
@@ -49,12 +53,18 @@ template <typename T>
 using ConstEigenMatrixMap =
     Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>;
 
+// Computes @rows outputs for every sample of the batch, using the weights of
+// those rows only. The outputs of consecutive samples are @output_stride apart.
+template <bool use_eigen>
+void MatMul(const size_t batch_size, const size_t input_size, const size_t rows,
+            const size_t output_stride, const float* inputs,
+            const float* weights, float* outputs);
+
 #ifdef USE_BLAS
 template <>
-void FullyConnectedLayer<false>::Forward1D(
-    size_t batch_size, const size_t input_size, const size_t output_size,
-    const float* inputs, const float* weights, const float* biases,
-    const ActivationFunction activation, float* outputs) {
+void MatMul<false>(const size_t batch_size, const size_t input_size,
+                   const size_t rows, const size_t output_stride,
+                   const float* inputs, const float* weights, float* outputs) {
   if (batch_size == 1) {
     // Just a matrix-vector multiplication
     //
@@ -68,8 +78,8 @@ void FullyConnectedLayer<false>::Forward1D(
     //
     cblas_sgemv(CblasRowMajor, CblasNoTrans,
                 // M     K
-                (int)output_size, (int)input_size, 1.0f, weights,
-                (int)input_size, inputs, 1, 0.0f, outputs, 1);
+                (int)rows, (int)input_size, 1.0f, weights, (int)input_size,
+                inputs, 1, 0.0f, outputs, 1);
   } else {
     // more columns, matrix-matrix multiplication
     //
@@ -91,21 +101,108 @@ void FullyConnectedLayer<false>::Forward1D(
     //    cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
     //                ldb, beta, C, N);
     cblas_sgemm(CblasColMajor, CblasTrans, CblasNoTrans,
-                (int)output_size,   // M
-                (int)batch_size,    // N
-                (int)input_size,    // K
-                1.0f,               // alpha
-                weights,            // A
-                (int)input_size,    // lda, leading rank of A
-                inputs,             // B
-                (int)input_size,    // ldb, leading rank of B
-                0.0f,               // beta
-                outputs,            // C
-                (int)output_size);  // ldc, leading rank of C
+                (int)rows,            // M
+                (int)batch_size,      // N
+                (int)input_size,      // K
+                1.0f,                 // alpha
+                weights,              // A
+                (int)input_size,      // lda, leading rank of A
+                inputs,               // B
+                (int)input_size,      // ldb, leading rank of B
+                0.0f,                 // beta
+                outputs,              // C
+                (int)output_stride);  // ldc, leading rank of C
+  }
+}
+#endif
+
+template <>
+void MatMul<true>(const size_t batch_size, const size_t input_size,
+                  const size_t rows, const size_t output_stride,
+                  const float* inputs, const float* weights, float* outputs) {
+  if (batch_size == 1) {
+    EigenVectorMap<float> y(outputs, rows);
+    y.noalias() =
+        ConstEigenMatrixMap<float>(weights, input_size, rows).transpose() *
+        ConstEigenVectorMap<float>(inputs, input_size);
+  } else {
+    auto C_mat = Eigen::Map<Eigen::MatrixXf, 0, Eigen::OuterStride<>>(
+        outputs, rows, batch_size, Eigen::OuterStride<>(output_stride));
+    C_mat.noalias() =
+        ConstEigenMatrixMap<float>(weights, input_size, rows).transpose() *
+        ConstEigenMatrixMap<float>(inputs, input_size, batch_size);
   }
+}
+
+// Size of the block of fp32 weights expanded at a time from reduced precision
+// storage. Small enough to stay in L2 cache.
+constexpr size_t kExpandedWeightsBlock = 64 * 1024;
+
+// Returns a buffer of at least @size floats to expand reduced precision weights
+// into. It is kept per thread and reused across calls, like the tile buffer of
+// the Winograd convolution.
+float* ExpansionScratch(size_t size) {
+  thread_local std::vector<float> scratch;
+  if (scratch.size() < size) scratch.resize(size);
+  return scratch.data();
+}
+}  // namespace
+
+template <bool use_eigen>
+void FullyConnectedLayer<use_eigen>::Forward1D(
+    size_t batch_size, const size_t input_size, const size_t output_size,
+    const float* inputs, const float* weights, const float* biases,
+    const ActivationFunction activation, float* outputs) {
+  MatMul<use_eigen>(batch_size, input_size, output_size, output_size, inputs,
+                    weights, outputs);
   ApplyBias(batch_size, output_size, biases, activation, outputs);
 }
 
+template <bool use_eigen>
+void FullyConnectedLayer<use_eigen>::Forward1D(
+    size_t batch_size, const size_t input_size, const size_t output_size,
+    const float* inputs, const WeightsStorage& weights, const float* biases,
+    const ActivationFunction activation, float* outputs) {
+  if (weights.packed()) {
+    PackedSgemm(weights.packed(0), batch_size, inputs, input_size, outputs,
+                output_size);
+    ApplyBias(batch_size, output_size, biases, activation, outputs);
+    return;
+  }
+  if (weights.precision() == WeightsPrecision::kFP32) {
+    Forward1D(batch_size, input_size, output_size, inputs,
+              weights.Get(0, weights.size(), nullptr), biases, activation,
+              outputs);
+    return;
+  }
+  const auto block_rows = std::min(
+      output_size, std::max(size_t{1}, kExpandedWeightsBlock / input_size));
+  auto scratch = ExpansionScratch(block_rows * input_size);
+  for (size_t row = 0; row < output_size; row += block_rows) {
+    const auto rows = std::min(block_rows, output_size - row);
+    MatMul<use_eigen>(batch_size, input_size, rows, output_size, inputs,
+                      weights.Get(row * input_size, rows * input_size, scratch),
+                      outputs + row);
+  }
+  ApplyBias(batch_size, output_size, biases, activation, outputs);
+}
+
+template <bool use_eigen>
+void FullyConnectedLayer<use_eigen>::ForwardRows(
+    const size_t input_size, const float* input, const WeightsStorage& weights,
+    const float* biases, const std::vector<uint16_t>& rows, float* output) {
+  assert(!weights.packed());
+  auto scratch = weights.precision() == WeightsPrecision::kFP32
+                     ? nullptr
+                     : ExpansionScratch(input_size);
+  for (auto row : rows) {
+    output[row] = Forward0D(input_size, input,
+                            weights.Get(row * input_size, input_size, scratch));
+    if (biases) output[row] += biases[row];
+  }
+}
+
+#ifdef USE_BLAS
 template <>
 float FullyConnectedLayer<false>::Forward0D(const size_t size, const float* x,
                                             const float* y) {
@@ -117,26 +214,6 @@ float FullyConnectedLayer<false>::Forward0D(const size_t size, const float* x,
 }
 #endif
 
-template <>
-void FullyConnectedLayer<true>::Forward1D(
-    size_t batch_size, const size_t input_size, const size_t output_size,
-    const float* inputs, const float* weights, const float* biases,
-    const ActivationFunction activation, float* outputs) {
-  if (batch_size == 1) {
-    EigenVectorMap<float> y(outputs, output_size);
-    y.noalias() = ConstEigenMatrixMap<float>(weights, input_size, output_size)
-                      .transpose() *
-                  ConstEigenVectorMap<float>(inputs, input_size);
-  } else {
-    auto C_mat = EigenMatrixMap<float>(outputs, output_size, batch_size);
-    C_mat.noalias() =
-        ConstEigenMatrixMap<float>(weights, input_size, output_size)
-            .transpose() *
-        ConstEigenMatrixMap<float>(inputs, input_size, batch_size);
-  }
-  ApplyBias(batch_size, output_size, biases, activation, outputs);
-}
-
 template <>
 float FullyConnectedLayer<true>::Forward0D(const size_t size, const float* x,
                                            const float* y) {
@@ -144,4 +221,9 @@ float FullyConnectedLayer<true>::Forward0D(const size_t size, const float* x,
       ConstEigenVectorMap<float>(y, size));
 }
 
+template class FullyConnectedLayer<true>;
+#ifdef USE_BLAS
+template class FullyConnectedLayer<false>;
+#endif
+
 }  // namespace lczero
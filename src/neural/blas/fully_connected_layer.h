@@ -18,9 +18,11 @@
 
 #pragma once
 
+#include "neural/blas/weights_storage.h"
 #include "neural/shared/activation.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace lczero {
@@ -30,12 +32,27 @@ class FullyConnectedLayer {
  public:
   FullyConnectedLayer() = delete;
 
-  // Forward inference, batched, from input_size to output_size
+  // Forward inference, batched, from input_size to output_size. The biases
+  // can be null if the activation is NONE.
   static void Forward1D(const size_t batch_size, const size_t input_size,
                         const size_t output_size, const float* input,
                         const float* weights, const float* biases,
                         const ActivationFunction activation, float* output);
 
+  // Same as above, with weights that may be stored in reduced precision. Those
+  // are expanded to fp32 a block of output rows at a time. Packed weights use
+  // the built-in GEMM kernels.
+  static void Forward1D(const size_t batch_size, const size_t input_size,
+                        const size_t output_size, const float* input,
+                        const WeightsStorage& weights, const float* biases,
+                        const ActivationFunction activation, float* output);
+
+  // Computes only the outputs @rows of a single sample, without activation,
+  // into the same positions of @output. Weights must not be packed.
+  static void ForwardRows(const size_t input_size, const float* input,
+                          const WeightsStorage& weights, const float* biases,
+                          const std::vector<uint16_t>& rows, float* output);
+
   // Forward inference, no batched, from input_size to scalar
   static float Forward0D(const size_t input_size, const float* input,
                          const float* weights);
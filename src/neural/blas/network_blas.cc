@@ -18,14 +18,21 @@
 
 #include <Eigen/Core>
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 #include "neural/blas/blas.h"
 #include "neural/blas/convolution1.h"
+#include "neural/blas/encoder.h"
+#include "neural/blas/expand_planes.h"
 #include "neural/blas/fully_connected_layer.h"
+#include "neural/blas/packed_gemm.h"
 #include "neural/blas/se_unit.h"
+#include "neural/blas/weights_storage.h"
 #include "neural/blas/winograd_convolution3.h"
 #include "neural/factory.h"
 #include "neural/network.h"
@@ -33,7 +40,11 @@
 #include "neural/shared/activation.h"
 #include "neural/shared/attention_policy_map.h"
 #include "neural/shared/policy_map.h"
+#include "neural/shared/weights_cache.h"
 #include "neural/shared/winograd_filter.h"
+#include "utils/cpu_features.h"
+#include "utils/fp16_utils.h"
+#include "utils/hashcat.h"
 
 #ifdef USE_DNNL
 #include <omp.h>
@@ -42,10 +53,94 @@
 namespace lczero {
 namespace {
 
+// The largest weight tensors of the network, taken out of LegacyWeights and
+// kept in the precision selected by the "precision" backend option.
+struct StoredWeights {
+  struct Residual {
+    WeightsStorage conv1;
+    WeightsStorage conv2;
+  };
+
+  WeightsStorage input;
+  std::vector<Residual> residual;
+  WeightsStorage policy1;
+  WeightsStorage policy;
+  WeightsStorage ip_pol_w;
+  WeightsStorage ip1_val_w;
+  WeightsStorage ip1_mov_w;
+};
+
+void SaveStoredWeights(const StoredWeights& stored, BlobWriter* writer) {
+  stored.input.Save(writer);
+  writer->Write<uint64_t>(stored.residual.size());
+  for (const auto& residual : stored.residual) {
+    residual.conv1.Save(writer);
+    residual.conv2.Save(writer);
+  }
+  stored.policy1.Save(writer);
+  stored.policy.Save(writer);
+  stored.ip_pol_w.Save(writer);
+  stored.ip1_val_w.Save(writer);
+  stored.ip1_mov_w.Save(writer);
+}
+
+// Returns false if @data is empty or not a valid cache entry.
+bool LoadStoredWeights(std::string_view data, StoredWeights* stored) {
+  if (data.empty()) return false;
+  try {
+    BlobReader reader(data);
+    StoredWeights result;
+    result.input = WeightsStorage(&reader);
+    const auto residual_blocks = reader.Read<uint64_t>();
+    for (size_t i = 0; i < residual_blocks; i++) {
+      WeightsStorage conv1(&reader);
+      WeightsStorage conv2(&reader);
+      result.residual.push_back({std::move(conv1), std::move(conv2)});
+    }
+    result.policy1 = WeightsStorage(&reader);
+    result.policy = WeightsStorage(&reader);
+    result.ip_pol_w = WeightsStorage(&reader);
+    result.ip1_val_w = WeightsStorage(&reader);
+    result.ip1_mov_w = WeightsStorage(&reader);
+    if (!reader.done()) return false;
+    *stored = std::move(result);
+    return true;
+  } catch (const Exception& e) {
+    CERR << "Invalid weights cache entry: " << e.what();
+    return false;
+  }
+}
+
+// Everything the computations read from the weights file. It is not modified
+// after loading, so instances can share it.
+struct BlasWeights {
+  // With @skip_stored, the tensors which go to @stored are not decoded, as they
+  // are loaded from the weights cache.
+  BlasWeights(const pblczero::Weights& weights, bool skip_stored,
+              bool conv_policy)
+      : legacy(weights, skip_stored, skip_stored && conv_policy) {}
+
+  LegacyWeights legacy;
+  StoredWeights stored;
+};
+
+// Inverts a mapping from the output layout of a policy head to lc0 policy
+// indices, to look up the few outputs needed for the legal moves.
+template <size_t N>
+constexpr std::array<short, 1858> InvertPolicyMap(const short (&map)[N]) {
+  std::array<short, 1858> inverse{};
+  for (auto& index : inverse) index = -1;
+  for (size_t i = 0; i < N; i++) {
+    if (map[i] >= 0) inverse[map[i]] = i;
+  }
+  return inverse;
+}
+
 template <bool use_eigen>
 class BlasComputation : public NetworkComputation {
  public:
-  BlasComputation(const LegacyWeights& weights, const size_t max_batch_size,
+  BlasComputation(const LegacyWeights& weights, const StoredWeights& stored,
+                  const size_t max_batch_size,
                   const bool wdl, const bool moves_left, const bool conv_policy,
                   const ActivationFunction default_activation,
                   const bool attn_policy);
@@ -53,7 +148,16 @@ class BlasComputation : public NetworkComputation {
   virtual ~BlasComputation() {}
 
   // Adds a sample to the batch.
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithPolicyIndices(std::move(input), {});
+  }
+
+  // Adds a sample of which only the policy outputs @policy_indices are needed.
+  void AddInputWithPolicyIndices(
+      InputPlanes&& input, std::vector<uint16_t> policy_indices) override {
+    planes_.emplace_back(std::move(input));
+    policy_indices_.emplace_back(std::move(policy_indices));
+  }
 
   // Do the computation.
   void ComputeBlocking() override;
@@ -95,8 +199,6 @@ class BlasComputation : public NetworkComputation {
   }
 
  private:
-  void EncodePlanes(const InputPlanes& sample, float* buffer);
-
   static constexpr auto kWidth = 8;
   static constexpr auto kHeight = 8;
   static constexpr auto kSquares = kWidth * kHeight;
@@ -106,8 +208,11 @@ class BlasComputation : public NetworkComputation {
   static constexpr auto kPolicyUsedPlanes = 73;
 
   const LegacyWeights& weights_;
+  const StoredWeights& stored_;
   size_t max_batch_size_;
   std::vector<InputPlanes> planes_;
+  // Empty when all the policy outputs of the sample are needed.
+  std::vector<std::vector<uint16_t>> policy_indices_;
   std::vector<std::vector<float>> policies_;
   std::vector<float> q_values_;
   std::vector<float> m_values_;
@@ -126,7 +231,8 @@ class BlasNetwork : public Network {
 
   std::unique_ptr<NetworkComputation> NewComputation() override {
     return std::make_unique<BlasComputation<use_eigen>>(
-        weights_, max_batch_size_, wdl_, moves_left_, conv_policy_,
+        weights_->legacy, weights_->stored, max_batch_size_, wdl_, moves_left_,
+        conv_policy_,
         default_activation_, attn_policy_);
   }
 
@@ -138,8 +244,16 @@ class BlasNetwork : public Network {
   // A cap on the max batch size since it consumes a lot of memory
   static constexpr auto kHardMaxBatchSize = 2048;
 
+  // Decodes the weights and transforms them to the layout of the layers.
+  // @key hashes the network file and the options the layout depends on.
+  std::unique_ptr<BlasWeights> PrepareWeights(const WeightsFile& file,
+                                              const OptionsDict& options,
+                                              WeightsPrecision precision,
+                                              bool builtin_gemm,
+                                              uint64_t key) const;
+
   const NetworkCapabilities capabilities_;
-  LegacyWeights weights_;
+  std::shared_ptr<const BlasWeights> weights_;
   size_t max_batch_size_;
   bool wdl_;
   bool moves_left_;
@@ -150,10 +264,12 @@ class BlasNetwork : public Network {
 
 template <bool use_eigen>
 BlasComputation<use_eigen>::BlasComputation(
-    const LegacyWeights& weights, const size_t max_batch_size, const bool wdl,
-    const bool moves_left, const bool conv_policy,
-    const ActivationFunction default_activation, const bool attn_policy)
+    const LegacyWeights& weights, const StoredWeights& stored,
+    const size_t max_batch_size, const bool wdl, const bool moves_left,
+    const bool conv_policy, const ActivationFunction default_activation,
+    const bool attn_policy)
     : weights_(weights),
+      stored_(stored),
       max_batch_size_(max_batch_size),
       policies_(0),
       q_values_(0),
@@ -222,6 +338,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
                                  kSquares);
   std::vector<float> res_buffer3(largest_batch_size * output_channels *
                                  kSquares);
+  std::vector<float> se_pool(largest_batch_size * output_channels);
 
   WinogradConvolution3<use_eigen> convolve3(largest_batch_size, max_channels,
                                             max_output_channels);
@@ -235,6 +352,12 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
   }
   std::vector<float> head_buffer(largest_batch_size * max_head_planes *
                                  kSquares);
+  // Attention policy encoder buffers, allocated by the encoder layers.
+  std::vector<float> encoder_q;
+  std::vector<float> encoder_k;
+  std::vector<float> encoder_v;
+  std::vector<float> encoder_attn;
+  std::vector<float> encoder_ffn;
 
   // These ones will rotate during the computation.
   float* conv_in = res_buffer1.data();
@@ -244,20 +367,19 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
   for (size_t i = 0; i < plane_count; i += largest_batch_size) {
     const auto batch_size = std::min(plane_count - i, largest_batch_size);
     for (size_t j = 0; j < batch_size; j++) {
-      EncodePlanes(planes_[i + j], &conv_in[j * kSquares * kInputPlanes]);
+      ExpandPlanes(planes_[i + j], &conv_in[j * kSquares * kInputPlanes]);
     }
 
     // Input convolution
 
     convolve3.Forward(batch_size, kInputPlanes, output_channels, conv_in,
-                      weights_.input.weights.data(), conv_out);
-
-    BiasActivate(batch_size, output_channels, conv_out,
-                 weights_.input.biases.data(), default_activation_);
+                      stored_.input, weights_.input.biases.data(), nullptr,
+                      default_activation_, conv_out);
 
     // Residual tower
 
-    for (auto& residual : weights_.residual) {
+    for (size_t block = 0; block < weights_.residual.size(); block++) {
+      const auto& residual = weights_.residual[block];
       const auto& conv1 = residual.conv1;
       const auto& conv2 = residual.conv2;
       const auto& se = residual.se;
@@ -265,32 +387,45 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       std::swap(conv_out, conv_in);
 
       convolve3.Forward(batch_size, output_channels, output_channels, conv_in,
-                        conv1.weights.data(), conv_out);
-
-      BiasActivate(batch_size, output_channels, &conv_out[0],
-                   conv1.biases.data(), default_activation_);
+                        stored_.residual[block].conv1, conv1.biases.data(),
+                        nullptr, default_activation_, conv_out);
 
       std::swap(conv_in, res);
       std::swap(conv_out, conv_in);
 
-      convolve3.Forward(batch_size, output_channels, output_channels, conv_in,
-                        conv2.weights.data(), conv_out);
-
       if (residual.has_se) {
-        // No relu if followed by SE-unit and residual/bias is added later
+        // No relu if followed by SE-unit and residual/bias is added later,
+        // the output transform only collects the channel averages.
+        convolve3.ForwardPooled(batch_size, output_channels, output_channels,
+                                conv_in, stored_.residual[block].conv2,
+                                conv_out, se_pool.data());
+
         std::swap(conv_out, conv_in);
 
         auto se_fc_outputs = se.b1.size();
         ApplySEUnit<use_eigen>(batch_size, output_channels, se_fc_outputs,
-                               conv_in, conv2.biases.data(), res, se.w1.data(),
-                               se.b1.data(), se.w2.data(), se.b2.data(),
-                               conv_out, default_activation_);
+                               conv_in, se_pool.data(), conv2.biases.data(),
+                               res, se.w1.data(), se.b1.data(), se.w2.data(),
+                               se.b2.data(), conv_out, default_activation_);
       } else {
-        BiasResidual(batch_size, output_channels, &conv_out[0],
-                     conv2.biases.data(), res, default_activation_);
+        convolve3.Forward(batch_size, output_channels, output_channels, conv_in,
+                          stored_.residual[block].conv2, conv2.biases.data(),
+                          res, default_activation_, conv_out);
       }
     }
 
+    // When only some policy outputs (those of the legal moves) are needed for
+    // every sample, the heads compute and copy just those, leaving the rest
+    // zero.
+    const auto* policy_indices = &policy_indices_[i];
+    const bool restricted_policy =
+        std::none_of(policy_indices, policy_indices + batch_size,
+                     [](const auto& indices) { return indices.empty(); });
+    if (restricted_policy) {
+      std::fill(output_fc.begin(),
+                output_fc.begin() + batch_size * num_output_policy, 0.0f);
+    }
+
     // Need to preserve conv_out which is used for value and moves left heads.
     if (attn_policy_) {
       // NCHW to NHWC conversion.
@@ -306,15 +441,88 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       // Embedding.
       FullyConnectedLayer<use_eigen>::Forward1D(
           batch_size * kSquares, output_channels, embedding_size, res,
-          weights_.ip_pol_w.data(), weights_.ip_pol_b.data(),
+          stored_.ip_pol_w, weights_.ip_pol_b.data(),
           SELU,  // SELU activation for attention head.
           head_buffer.data());
 
-      for (auto layer : weights_.pol_encoder) {
-        // TODO: support encoder heads.
-        throw Exception(
-            "Eigen/Blas backend doesn't support encoder heads yet.");
+      // Encoder layers, each one over the whole batch at once.
+      for (const auto& layer : weights_.pol_encoder) {
+        const size_t d_model = layer.mha.q_b.size();
+        const size_t heads = weights_.pol_encoder_head_count;
+        const size_t depth = d_model / heads;
+        const size_t dff = layer.ffn.dense1_b.size();
+        const size_t rows = batch_size * kSquares;
+
+        encoder_q.resize(rows * d_model);
+        // k also holds the output of the attention block.
+        encoder_k.resize(rows * std::max(d_model, embedding_size));
+        encoder_v.resize(rows * d_model);
+        encoder_attn.resize(heads * batch_size * kSquares * kSquares);
+        encoder_ffn.resize(rows * dff);
+
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, embedding_size, d_model, head_buffer.data(),
+            layer.mha.q_w.data(), layer.mha.q_b.data(), NONE,
+            encoder_q.data());
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, embedding_size, d_model, head_buffer.data(),
+            layer.mha.k_w.data(), layer.mha.k_b.data(), NONE,
+            encoder_k.data());
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, embedding_size, d_model, head_buffer.data(),
+            layer.mha.v_w.data(), layer.mha.v_b.data(), NONE,
+            encoder_v.data());
+
+        // Scaled dot product attention, the heads are slices of depth
+        // columns of q, k and v. The attention weights of a head are stored
+        // for the whole batch, followed by those of the next head.
+        const float factor = 1.0f / std::sqrt(static_cast<float>(depth));
+        for (size_t h = 0; h < heads; h++) {
+          BatchedMatMul<use_eigen>(
+              batch_size, kSquares, kSquares, depth, factor,
+              &encoder_q[h * depth], d_model, kSquares * d_model,
+              &encoder_k[h * depth], d_model, kSquares * d_model, true,
+              &encoder_attn[h * batch_size * kSquares * kSquares], kSquares,
+              kSquares * kSquares);
+        }
+        SoftmaxRows(heads * batch_size * kSquares, kSquares,
+                    encoder_attn.data());
+        // The attention output goes to q, which is no longer needed.
+        for (size_t h = 0; h < heads; h++) {
+          BatchedMatMul<use_eigen>(
+              batch_size, kSquares, depth, kSquares, 1.0f,
+              &encoder_attn[h * batch_size * kSquares * kSquares], kSquares,
+              kSquares * kSquares, &encoder_v[h * depth], d_model,
+              kSquares * d_model, false, &encoder_q[h * depth], d_model,
+              kSquares * d_model);
+        }
+
+        // Dense layer, its bias is added by the layer normalization together
+        // with the skip connection.
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, d_model, embedding_size, encoder_q.data(),
+            layer.mha.dense_w.data(), nullptr, NONE, encoder_k.data());
+        LayerNorm2DWithSkipConnection(rows, embedding_size, encoder_k.data(),
+                                      layer.mha.dense_b.data(),
+                                      head_buffer.data(),
+                                      layer.ln1_gammas.data(),
+                                      layer.ln1_betas.data(), 1e-6f);
+
+        // Feed forward network.
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, embedding_size, dff, encoder_k.data(),
+            layer.ffn.dense1_w.data(), layer.ffn.dense1_b.data(), SELU,
+            encoder_ffn.data());
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            rows, dff, embedding_size, encoder_ffn.data(),
+            layer.ffn.dense2_w.data(), nullptr, NONE, head_buffer.data());
+        LayerNorm2DWithSkipConnection(rows, embedding_size, head_buffer.data(),
+                                      layer.ffn.dense2_b.data(),
+                                      encoder_k.data(),
+                                      layer.ln2_gammas.data(),
+                                      layer.ln2_betas.data(), 1e-6f);
       }
+
       const size_t policy_d_model = weights_.ip2_pol_b.size();
       std::vector<float> head_buffer2(largest_batch_size * policy_d_model *
                                       kSquares);
@@ -330,92 +538,107 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
           batch_size * kSquares, embedding_size, policy_d_model,
           head_buffer.data(), weights_.ip3_pol_w.data(),
           weights_.ip3_pol_b.data(), NONE, head_buffer3.data());
-      const float scaling = 1.0f / sqrtf(policy_d_model);
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        const float* A = &head_buffer2[batch * 64 * policy_d_model];
-        const float* B = &head_buffer3[batch * 64 * policy_d_model];
-        float* C = &head_buffer[batch * (64 * 64 + 8 * 24)];
-        if (use_eigen) {
-          auto C_mat = EigenMatrixMap<float>(C, kSquares, kSquares);
-          C_mat.noalias() =
-              scaling *
-              ConstEigenMatrixMap<float>(B, policy_d_model, kSquares)
-                  .transpose() *
-              ConstEigenMatrixMap<float>(A, policy_d_model, kSquares);
-        } else {
-#ifdef USE_BLAS
-          cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, kSquares,
-                      kSquares, policy_d_model, scaling, A, policy_d_model, B,
-                      policy_d_model, 0.0f, C, 64);
-#else
-          // Should never get here.
-          throw Exception("Blas backend internal error");
-#endif
-        }
-      }
-      // Promotion offset calculation.
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        float promotion_offsets[4][8];
-        // This is so small that SGEMM seems slower.
-        for (int i = 0; i < 4; i++) {
-          for (int j = 0; j < 8; j++) {
-            float sum = 0;
-            for (size_t k = 0; k < policy_d_model; k++) {
-              sum += head_buffer3.data()[batch * kSquares * policy_d_model +
-                                         (56 + j) * policy_d_model + k] *
-                     weights_.ip4_pol_w.data()[i * policy_d_model + k];
+
+      const size_t attn_policy_size = 64 * 64 + 8 * 24;
+      const float scaling = 1.0f / std::sqrt(static_cast<float>(policy_d_model));
+
+      // Promotion offsets, ip4_pol_w x transpose(K) for the keys of the 8th
+      // rank squares, 4 x 8 per sample.
+      std::vector<float> promotion_offsets(batch_size * 4 * 8);
+      BatchedMatMul<use_eigen>(batch_size, 4, 8, policy_d_model, 1.0f,
+                               weights_.ip4_pol_w.data(), policy_d_model, 0,
+                               &head_buffer3[56 * policy_d_model],
+                               policy_d_model, kSquares * policy_d_model, true,
+                               promotion_offsets.data(), 8, 4 * 8);
+
+      if (restricted_policy) {
+        // Only the needed logits, each a dot product of the query of the from
+        // square and the key of the to square.
+        static constexpr auto kInverseMap = InvertPolicyMap(kAttnPolicyMap);
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          const float* q = &head_buffer2[batch * kSquares * policy_d_model];
+          const float* k = &head_buffer3[batch * kSquares * policy_d_model];
+          const float* offsets = &promotion_offsets[batch * 4 * 8];
+          const auto logit = [&](int from, int to) {
+            return scaling * FullyConnectedLayer<use_eigen>::Forward0D(
+                                 policy_d_model, &q[from * policy_d_model],
+                                 &k[to * policy_d_model]);
+          };
+          for (auto j : policy_indices[batch]) {
+            const int idx = kInverseMap[j];
+            float value;
+            if (idx < 64 * 64) {
+              value = logit(idx / 64, idx % 64);
+            } else {
+              // Same layout as the promotion logits below.
+              const int rank = (idx - 64 * 64) / 24;
+              const int file = (idx - 64 * 64) % 24 / 3;
+              const int piece = (idx - 64 * 64) % 3;
+              value = logit(48 + rank, 56 + file) +
+                      offsets[piece * 8 + file] + offsets[3 * 8 + file];
             }
-            promotion_offsets[i][j] = sum;
+            output_fc[batch * num_output_policy + j] = value;
           }
         }
-        for (int i = 0; i < 3; i++) {
-          for (int j = 0; j < 8; j++) {
-            promotion_offsets[i][j] += promotion_offsets[3][j];
-          }
-        }
-        for (int k = 0; k < 8; k++) {      // y in cuda
-          for (int j = 0; j < 8; j++) {    // w in cuda
-            for (int i = 0; i < 3; i++) {  // c in cuda
-              head_buffer.data()[batch * (64 * 64 + 8 * 24) + 64 * 64 + 24 * k +
-                                 3 * j + i] =
-                  head_buffer.data()[batch * (64 * 64 + 8 * 24) +
-                                     (48 + k) * 64 + 56 + j] +
-                  promotion_offsets[i][j];
+      } else {
+        // Policy logits Q x transpose(K) / sqrt(d_model) for the whole batch,
+        // leaving room for the promotion logits after those of every sample.
+        BatchedMatMul<use_eigen>(
+            batch_size, kSquares, kSquares, policy_d_model, scaling,
+            head_buffer2.data(), policy_d_model, kSquares * policy_d_model,
+            head_buffer3.data(), policy_d_model, kSquares * policy_d_model,
+            true, head_buffer.data(), kSquares, attn_policy_size);
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          const float* offsets = &promotion_offsets[batch * 4 * 8];
+          float* logits = &head_buffer[batch * attn_policy_size];
+          for (int k = 0; k < 8; k++) {      // y in cuda
+            for (int j = 0; j < 8; j++) {    // w in cuda
+              for (int i = 0; i < 3; i++) {  // c in cuda
+                logits[64 * 64 + 24 * k + 3 * j + i] =
+                    logits[(48 + k) * 64 + 56 + j] + offsets[i * 8 + j] +
+                    offsets[3 * 8 + j];
+              }
             }
           }
         }
-      }
-      // Mapping from attention policy to lc0 policy
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        for (auto i = 0; i < 64 * 64 + 8 * 24; i++) {
-          auto j = kAttnPolicyMap[i];
-          if (j >= 0) {
-            output_fc[batch * num_output_policy + j] =
-                head_buffer[batch * (64 * 64 + 8 * 24) + i];
+        // Mapping from attention policy to lc0 policy
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          for (auto i = 0; i < 64 * 64 + 8 * 24; i++) {
+            auto j = kAttnPolicyMap[i];
+            if (j >= 0) {
+              output_fc[batch * num_output_policy + j] =
+                  head_buffer[batch * (64 * 64 + 8 * 24) + i];
+            }
           }
         }
       }
     } else if (conv_policy_) {
       convolve3.Forward(batch_size, output_channels, output_channels, conv_out,
-                        weights_.policy1.weights.data(), res);
-
-      BiasActivate(batch_size, output_channels, &res[0],
-                   weights_.policy1.biases.data(), default_activation_);
+                        stored_.policy1, weights_.policy1.biases.data(),
+                        nullptr, default_activation_, res);
 
       convolve3.Forward(batch_size, output_channels, num_policy_input_planes,
-                        res, weights_.policy.weights.data(),
-                        head_buffer.data());
-
-      BiasActivate(batch_size, num_policy_input_planes, &head_buffer.data()[0],
-                   weights_.policy.biases.data(), NONE);
+                        res, stored_.policy, weights_.policy.biases.data(),
+                        nullptr, NONE, head_buffer.data());
 
       // Mapping from convolutional policy to lc0 policy
-      for (auto batch = size_t{0}; batch < batch_size; batch++) {
-        for (auto i = 0; i < kPolicyUsedPlanes * kSquares; i++) {
-          auto j = kConvPolicyMap[i];
-          if (j >= 0) {
+      if (restricted_policy) {
+        static constexpr auto kInverseMap = InvertPolicyMap(kConvPolicyMap);
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          for (auto j : policy_indices[batch]) {
             output_fc[batch * num_output_policy + j] =
-                head_buffer[batch * num_policy_input_planes * kSquares + i];
+                head_buffer[batch * num_policy_input_planes * kSquares +
+                            kInverseMap[j]];
+          }
+        }
+      } else {
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          for (auto i = 0; i < kPolicyUsedPlanes * kSquares; i++) {
+            auto j = kConvPolicyMap[i];
+            if (j >= 0) {
+              output_fc[batch * num_output_policy + j] =
+                  head_buffer[batch * num_policy_input_planes * kSquares + i];
+            }
           }
         }
       }
@@ -428,12 +651,23 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
       BiasActivate(batch_size, num_policy_input_planes, &head_buffer[0],
                    weights_.policy.biases.data(), default_activation_);
 
-      FullyConnectedLayer<use_eigen>::Forward1D(
-          batch_size, num_policy_input_planes * kSquares, num_output_policy,
-          head_buffer.data(), weights_.ip_pol_w.data(),
-          weights_.ip_pol_b.data(),
-          NONE,  // Activation Off
-          output_fc.data());
+      if (restricted_policy && !stored_.ip_pol_w.packed()) {
+        // Only the rows of the needed outputs are read, a small part of the
+        // largest weight matrix of the network.
+        const size_t input_size = num_policy_input_planes * kSquares;
+        for (auto batch = size_t{0}; batch < batch_size; batch++) {
+          FullyConnectedLayer<use_eigen>::ForwardRows(
+              input_size, &head_buffer[batch * input_size], stored_.ip_pol_w,
+              weights_.ip_pol_b.data(), policy_indices[batch],
+              &output_fc[batch * num_output_policy]);
+        }
+      } else {
+        FullyConnectedLayer<use_eigen>::Forward1D(
+            batch_size, num_policy_input_planes * kSquares, num_output_policy,
+            head_buffer.data(), stored_.ip_pol_w, weights_.ip_pol_b.data(),
+            NONE,  // Activation Off
+            output_fc.data());
+      }
     }
 
     for (size_t j = 0; j < batch_size; j++) {
@@ -455,8 +689,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 
     FullyConnectedLayer<use_eigen>::Forward1D(
         batch_size, num_value_input_planes * kSquares, num_value_channels,
-        head_buffer.data(), weights_.ip1_val_w.data(),
-        weights_.ip1_val_b.data(),
+        head_buffer.data(), stored_.ip1_val_w, weights_.ip1_val_b.data(),
         default_activation_,  // Activation On
         output_fc.data());
 
@@ -497,8 +730,7 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
 
       FullyConnectedLayer<use_eigen>::Forward1D(
           batch_size, num_moves_input_planes * kSquares, num_moves_channels,
-          head_buffer.data(), weights_.ip1_mov_w.data(),
-          weights_.ip1_mov_b.data(),
+          head_buffer.data(), stored_.ip1_mov_w, weights_.ip1_mov_b.data(),
           default_activation_,  // Activation On
           output_fc.data());
 
@@ -516,22 +748,11 @@ void BlasComputation<use_eigen>::ComputeBlocking() {
   }
 }
 
-template <bool use_eigen>
-void BlasComputation<use_eigen>::EncodePlanes(const InputPlanes& sample,
-                                              float* buffer) {
-  for (const InputPlane& plane : sample) {
-    const float value = plane.value;
-    for (auto i = 0; i < kSquares; i++)
-      *(buffer++) = (plane.mask & (((uint64_t)1) << i)) != 0 ? value : 0;
-  }
-}
-
 template <bool use_eigen>
 BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
                                     const OptionsDict& options)
     : capabilities_{file.format().network_format().input(),
-                    file.format().network_format().moves_left()},
-      weights_(file.weights()) {
+                    file.format().network_format().moves_left()} {
   max_batch_size_ =
       static_cast<size_t>(options.GetOrDefault<int>("batch_size", 256));
 
@@ -557,30 +778,48 @@ BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
     max_batch_size_ = kHardMaxBatchSize;
   }
 
-  const auto inputChannels = kInputPlanes;
-  const auto channels = static_cast<int>(weights_.input.biases.size());
-  const auto residual_blocks = weights_.residual.size();
-
-  weights_.input.weights =
-      WinogradFilterTransformF(weights_.input.weights, channels, inputChannels);
+  const auto precision = ParseWeightsPrecision(
+      options.GetOrDefault<std::string>("precision", "fp32"));
 
-  // residual blocks
-  for (size_t i = 0; i < residual_blocks; i++) {
-    auto& residual = weights_.residual[i];
-    auto& conv1 = residual.conv1;
-    auto& conv2 = residual.conv2;
+  const bool builtin_gemm = options.GetOrDefault<bool>("builtin_gemm", false);
+  if (builtin_gemm && precision != WeightsPrecision::kFP32) {
+    throw Exception("The built-in GEMM kernels need fp32 weights.");
+  }
 
-    conv1.weights = WinogradFilterTransformF(conv1.weights, channels, channels);
-    conv2.weights = WinogradFilterTransformF(conv2.weights, channels, channels);
+  // Instances using the same network with the same weights layout share the
+  // prepared weights, e.g. the children of roundrobin or demux.
+  static SharedWeightsStore<BlasWeights> store;
+  const uint64_t key = HashCat(
+      {use_eigen, static_cast<uint64_t>(precision), builtin_gemm,
+       HashBytes(file.format().OutputAsString()), HashWeights(file.weights())});
+  bool shared = true;
+  weights_ = store.Get(key, [&]() {
+    shared = false;
+    return PrepareWeights(file, options, precision, builtin_gemm, key);
+  });
+  if (shared) CERR << "Sharing the weights of another instance.";
+  const auto& stored = weights_->stored;
+
+  // The kernels picked at runtime for this processor.
+  CERR << "CPU features: " << CpuFeaturesString() << ".";
+  CERR << "Plane expansion kernel: " << ExpandPlanesKernelName()
+       << ", fp16 expansion: " << FP16toFP32PathName() << ".";
+  if (const char* ispc_target = IspcTargetName()) {
+    CERR << "ISPC kernels target: " << ispc_target << ".";
+  }
+  if (builtin_gemm) {
+    CERR << "Using the built-in GEMM kernels (" << PackedGemmKernelName()
+         << ").";
   }
 
-  if (conv_policy_) {
-    weights_.policy1.weights =
-        WinogradFilterTransformF(weights_.policy1.weights, channels, channels);
-    auto pol_channels = weights_.policy.biases.size();
-    weights_.policy.weights = WinogradFilterTransformF(weights_.policy.weights,
-                                                       pol_channels, channels);
+  size_t stored_bytes = stored.input.bytes() + stored.policy1.bytes() +
+                        stored.policy.bytes() + stored.ip_pol_w.bytes() +
+                        stored.ip1_val_w.bytes() + stored.ip1_mov_w.bytes();
+  for (const auto& residual : stored.residual) {
+    stored_bytes += residual.conv1.bytes() + residual.conv2.bytes();
   }
+  CERR << "Weights precision " << WeightsPrecisionName(precision) << ", "
+       << stored_bytes / (1024 * 1024) << " MiB in the main layers.";
 
   if (use_eigen) {
     CERR << "Using Eigen version " << EIGEN_WORLD_VERSION << "."
@@ -623,6 +862,117 @@ BlasNetwork<use_eigen>::BlasNetwork(const WeightsFile& file,
   }
 }
 
+template <bool use_eigen>
+std::unique_ptr<BlasWeights> BlasNetwork<use_eigen>::PrepareWeights(
+    const WeightsFile& file, const OptionsDict& options,
+    WeightsPrecision precision, bool builtin_gemm, uint64_t key) const {
+  // Looked up before decoding, so that a hit skips decoding the large tensors.
+  // The prepared weights also depend on the GEMM kernel layout.
+  std::optional<WeightsCache> cache;
+  if (options.GetOrDefault<bool>("weights_cache", false)) {
+    if (builtin_gemm) {
+      for (const char c : std::string_view(PackedGemmKernelName())) {
+        key = HashCat(key, c);
+      }
+    }
+    try {
+      cache.emplace(
+          options.GetOrDefault<std::string>("weights_cache_dir", ""), key);
+    } catch (const Exception& e) {
+      CERR << "Weights cache disabled: " << e.what();
+    }
+  }
+
+  StoredWeights cached;
+  if (cache && LoadStoredWeights(cache->Load(), &cached)) {
+    CERR << "Loaded prepared weights from the cache.";
+    auto weights =
+        std::make_unique<BlasWeights>(file.weights(), true, conv_policy_);
+    weights->stored = std::move(cached);
+    return weights;
+  }
+
+  auto weights =
+      std::make_unique<BlasWeights>(file.weights(), false, conv_policy_);
+  auto& legacy = weights->legacy;
+  auto& stored = weights->stored;
+
+  const auto inputChannels = kInputPlanes;
+  const auto channels = static_cast<int>(legacy.input.biases.size());
+  const auto residual_blocks = legacy.residual.size();
+
+  legacy.input.weights = WinogradFilterTransformF(legacy.input.weights,
+                                                  channels, inputChannels);
+
+  // residual blocks
+  for (size_t i = 0; i < residual_blocks; i++) {
+    auto& residual = legacy.residual[i];
+    auto& conv1 = residual.conv1;
+    auto& conv2 = residual.conv2;
+
+    conv1.weights = WinogradFilterTransformF(conv1.weights, channels, channels);
+    conv2.weights = WinogradFilterTransformF(conv2.weights, channels, channels);
+  }
+
+  if (conv_policy_) {
+    legacy.policy1.weights =
+        WinogradFilterTransformF(legacy.policy1.weights, channels, channels);
+    auto pol_channels = legacy.policy.biases.size();
+    legacy.policy.weights = WinogradFilterTransformF(
+        legacy.policy.weights, pol_channels, channels);
+  }
+
+  // Move the large tensors to their final storage.
+  stored.input = WeightsStorage(std::move(legacy.input.weights), precision);
+  for (auto& residual : legacy.residual) {
+    stored.residual.push_back(
+        {WeightsStorage(std::move(residual.conv1.weights), precision),
+         WeightsStorage(std::move(residual.conv2.weights), precision)});
+  }
+  if (conv_policy_) {
+    stored.policy1 =
+        WeightsStorage(std::move(legacy.policy1.weights), precision);
+    stored.policy = WeightsStorage(std::move(legacy.policy.weights), precision);
+  }
+  stored.ip_pol_w = WeightsStorage(std::move(legacy.ip_pol_w), precision);
+  stored.ip1_val_w = WeightsStorage(std::move(legacy.ip1_val_w), precision);
+  stored.ip1_mov_w = WeightsStorage(std::move(legacy.ip1_mov_w), precision);
+
+  if (builtin_gemm) {
+    // The 4x4 Winograd tiles are output x input channels, column major.
+    const auto pack_winograd = [](WeightsStorage* weights, size_t outputs) {
+      constexpr size_t kWinogradTile = 16;
+      weights->Pack(kWinogradTile, outputs,
+                    weights->size() / kWinogradTile / outputs, false);
+    };
+    // Fully connected layers are one row of inputs per output.
+    const auto pack_fc = [](WeightsStorage* weights, size_t outputs) {
+      if (outputs == 0) return;
+      weights->Pack(1, outputs, weights->size() / outputs, true);
+    };
+    pack_winograd(&stored.input, channels);
+    for (auto& residual : stored.residual) {
+      pack_winograd(&residual.conv1, channels);
+      pack_winograd(&residual.conv2, channels);
+    }
+    if (conv_policy_) {
+      pack_winograd(&stored.policy1, channels);
+      pack_winograd(&stored.policy, legacy.policy.biases.size());
+    }
+    pack_fc(&stored.ip_pol_w, legacy.ip_pol_b.size());
+    pack_fc(&stored.ip1_val_w, legacy.ip1_val_b.size());
+    pack_fc(&stored.ip1_mov_w, legacy.ip1_mov_b.size());
+  }
+
+  if (cache) {
+    BlobWriter writer;
+    SaveStoredWeights(stored, &writer);
+    cache->Store(writer.data());
+  }
+
+  return weights;
+}
+
 template <bool use_eigen>
 std::unique_ptr<Network> MakeBlasNetwork(const std::optional<WeightsFile>& w,
                                          const OptionsDict& options) {
@@ -0,0 +1,257 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "neural/blas/packed_gemm.h"
+
+#include <algorithm>
+
+#include "neural/shared/weights_cache.h"
+#include "utils/cpu_features.h"
+#include "utils/exception.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#include <immintrin.h>
+#define PACKED_GEMM_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PACKED_GEMM_NEON
+#endif
+
+// The x86 kernels are compiled for their ISA regardless of the compiler flags
+// and picked at runtime, so that a single binary runs fast everywhere.
+#if defined(__GNUC__)
+#define PACKED_GEMM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PACKED_GEMM_TARGET(isa)
+#endif
+
+namespace lczero {
+namespace {
+
+constexpr size_t kMr = kPackedGemmRows;
+// Columns of the output computed by one micro-kernel call.
+constexpr size_t kNr = 6;
+// Depth of the block of weights and inputs kept in cache, 16 KiB of a panel.
+constexpr size_t kKc = 256;
+
+// A micro-kernel computes the kMr x kNr tile = panel x [cols[0] ...
+// cols[kNr - 1]] over @depth, the tile is stored column major.
+using MicroKernel = void (*)(size_t depth, const float* panel,
+                             const float* const* cols, float* tile);
+
+// Written so that the compiler can vectorize the inner loop.
+void GenericKernel(size_t depth, const float* panel, const float* const* cols,
+                   float* tile) {
+  float acc[kNr][kMr] = {};
+  for (size_t k = 0; k < depth; k++) {
+    const float* a = panel + k * kMr;
+    for (size_t j = 0; j < kNr; j++) {
+      const float b = cols[j][k];
+      for (size_t i = 0; i < kMr; i++) acc[j][i] += a[i] * b;
+    }
+  }
+  std::copy(&acc[0][0], &acc[0][0] + kNr * kMr, tile);
+}
+
+#ifdef PACKED_GEMM_X86
+PACKED_GEMM_TARGET("avx512f")
+void Avx512Kernel(size_t depth, const float* panel, const float* const* cols,
+                  float* tile) {
+  __m512 acc[kNr];
+  for (size_t j = 0; j < kNr; j++) acc[j] = _mm512_setzero_ps();
+  for (size_t k = 0; k < depth; k++) {
+    const __m512 a = _mm512_loadu_ps(panel + k * kMr);
+    for (size_t j = 0; j < kNr; j++) {
+      acc[j] = _mm512_fmadd_ps(a, _mm512_set1_ps(cols[j][k]), acc[j]);
+    }
+  }
+  for (size_t j = 0; j < kNr; j++) _mm512_storeu_ps(tile + j * kMr, acc[j]);
+}
+
+PACKED_GEMM_TARGET("avx2,fma")
+void Avx2Kernel(size_t depth, const float* panel, const float* const* cols,
+                float* tile) {
+  __m256 acc[kNr][2];
+  for (size_t j = 0; j < kNr; j++) {
+    acc[j][0] = _mm256_setzero_ps();
+    acc[j][1] = _mm256_setzero_ps();
+  }
+  for (size_t k = 0; k < depth; k++) {
+    const __m256 a0 = _mm256_loadu_ps(panel + k * kMr);
+    const __m256 a1 = _mm256_loadu_ps(panel + k * kMr + 8);
+    for (size_t j = 0; j < kNr; j++) {
+      const __m256 b = _mm256_broadcast_ss(cols[j] + k);
+      acc[j][0] = _mm256_fmadd_ps(a0, b, acc[j][0]);
+      acc[j][1] = _mm256_fmadd_ps(a1, b, acc[j][1]);
+    }
+  }
+  for (size_t j = 0; j < kNr; j++) {
+    _mm256_storeu_ps(tile + j * kMr, acc[j][0]);
+    _mm256_storeu_ps(tile + j * kMr + 8, acc[j][1]);
+  }
+}
+#endif
+
+#ifdef PACKED_GEMM_NEON
+void NeonKernel(size_t depth, const float* panel, const float* const* cols,
+                float* tile) {
+  float32x4_t acc[kNr][4];
+  for (size_t j = 0; j < kNr; j++) {
+    for (size_t i = 0; i < 4; i++) acc[j][i] = vdupq_n_f32(0.0f);
+  }
+  for (size_t k = 0; k < depth; k++) {
+    float32x4_t a[4];
+    for (size_t i = 0; i < 4; i++) a[i] = vld1q_f32(panel + k * kMr + 4 * i);
+    for (size_t j = 0; j < kNr; j++) {
+      const float b = cols[j][k];
+      for (size_t i = 0; i < 4; i++) acc[j][i] = vfmaq_n_f32(acc[j][i], a[i], b);
+    }
+  }
+  for (size_t j = 0; j < kNr; j++) {
+    for (size_t i = 0; i < 4; i++) vst1q_f32(tile + j * kMr + 4 * i, acc[j][i]);
+  }
+}
+#endif
+
+struct KernelChoice {
+  MicroKernel kernel;
+  const char* name;
+};
+
+// The kernels this processor can run, fastest first.
+std::vector<KernelChoice> AvailableKernels() {
+  const auto& features = GetCpuFeatures();
+  std::vector<KernelChoice> kernels;
+#ifdef PACKED_GEMM_X86
+  if (features.avx512f) kernels.push_back({Avx512Kernel, "avx512"});
+  if (features.avx2 && features.fma) kernels.push_back({Avx2Kernel, "avx2"});
+#endif
+#ifdef PACKED_GEMM_NEON
+  if (features.neon) kernels.push_back({NeonKernel, "neon"});
+#endif
+  (void)features;
+  kernels.push_back({GenericKernel, "generic"});
+  return kernels;
+}
+
+const KernelChoice& GetKernel() {
+  static const KernelChoice choice = AvailableKernels().front();
+  return choice;
+}
+
+void PackedSgemm(MicroKernel kernel, const PackedMatrix& weights,
+                 size_t columns, const float* input, size_t ldi, float* output,
+                 size_t ldo) {
+  const size_t rows = weights.rows();
+  const size_t depth = weights.depth();
+  float tile[kNr * kMr];
+  const float* cols[kNr];
+
+  for (size_t k0 = 0; k0 < depth; k0 += kKc) {
+    const size_t kc = std::min(kKc, depth - k0);
+    for (size_t n0 = 0; n0 < columns; n0 += kNr) {
+      const size_t nr = std::min(kNr, columns - n0);
+      // Missing columns repeat the last one, their results are dropped.
+      for (size_t j = 0; j < kNr; j++) {
+        cols[j] = input + (n0 + std::min(j, nr - 1)) * ldi + k0;
+      }
+      for (size_t p = 0; p < weights.panels(); p++) {
+        kernel(kc, weights.panel(p) + k0 * kMr, cols, tile);
+        const size_t mr = std::min(kMr, rows - p * kMr);
+        for (size_t j = 0; j < nr; j++) {
+          float* out = output + (n0 + j) * ldo + p * kMr;
+          const float* res = tile + j * kMr;
+          if (k0 == 0) {
+            std::copy(res, res + mr, out);
+          } else {
+            for (size_t i = 0; i < mr; i++) out[i] += res[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+PackedMatrix::PackedMatrix(const float* weights, size_t rows, size_t depth,
+                           size_t row_stride, size_t depth_stride)
+    : rows_(rows),
+      depth_(depth),
+      panels_((rows + kMr - 1) / kMr),
+      data_(panels_ * kMr * depth, 0.0f) {
+  for (size_t p = 0; p < panels_; p++) {
+    float* panel = &data_[p * kMr * depth];
+    const size_t panel_rows = std::min(kMr, rows - p * kMr);
+    for (size_t d = 0; d < depth; d++) {
+      for (size_t i = 0; i < panel_rows; i++) {
+        panel[d * kMr + i] =
+            weights[(p * kMr + i) * row_stride + d * depth_stride];
+      }
+    }
+  }
+}
+
+PackedMatrix::PackedMatrix(BlobReader* reader)
+    : rows_(reader->Read<uint64_t>()),
+      depth_(reader->Read<uint64_t>()),
+      panels_((rows_ + kMr - 1) / kMr),
+      data_(reader->ReadVector<float>()) {
+  if (data_.size() != panels_ * kMr * depth_) {
+    throw Exception("Invalid packed matrix in the weights cache.");
+  }
+}
+
+void PackedMatrix::Save(BlobWriter* writer) const {
+  writer->Write<uint64_t>(rows_);
+  writer->Write<uint64_t>(depth_);
+  writer->Write<uint64_t>(data_.size());
+  writer->Write(data_.data(), data_.size());
+}
+
+const float* PackedMatrix::panel(size_t p) const {
+  return &data_[p * kMr * depth_];
+}
+
+void PackedSgemm(const PackedMatrix& weights, size_t columns,
+                 const float* input, size_t ldi, float* output, size_t ldo) {
+  PackedSgemm(GetKernel().kernel, weights, columns, input, ldi, output, ldo);
+}
+
+const char* PackedGemmKernelName() { return GetKernel().name; }
+
+std::vector<std::string> PackedGemmKernelNames() {
+  std::vector<std::string> names;
+  for (const auto& kernel : AvailableKernels()) names.push_back(kernel.name);
+  return names;
+}
+
+void PackedSgemmWithKernel(const std::string& kernel,
+                           const PackedMatrix& weights, size_t columns,
+                           const float* input, size_t ldi, float* output,
+                           size_t ldo) {
+  for (const auto& choice : AvailableKernels()) {
+    if (choice.name != kernel) continue;
+    PackedSgemm(choice.kernel, weights, columns, input, ldi, output, ldo);
+    return;
+  }
+  throw Exception("The " + kernel + " GEMM kernel can't run here.");
+}
+
+}  // namespace lczero
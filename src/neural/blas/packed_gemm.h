@@ -0,0 +1,78 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lczero {
+
+class BlobReader;
+class BlobWriter;
+
+// A rows x depth weights matrix, repacked at load time for the built-in GEMM
+// kernels: panels of kPackedGemmRows rows (the last one zero padded), each
+// stored depth-major so that a kernel reads it sequentially.
+class PackedMatrix {
+ public:
+  // Element (r, d) of the matrix is weights[r * row_stride + d * depth_stride].
+  PackedMatrix(const float* weights, size_t rows, size_t depth,
+               size_t row_stride, size_t depth_stride);
+  // Reads a matrix written by Save() from the weights cache.
+  explicit PackedMatrix(BlobReader* reader);
+  void Save(BlobWriter* writer) const;
+
+  size_t rows() const { return rows_; }
+  size_t depth() const { return depth_; }
+  size_t panels() const { return panels_; }
+  const float* panel(size_t p) const;
+  size_t bytes() const { return data_.size() * sizeof(float); }
+
+ private:
+  size_t rows_;
+  size_t depth_;
+  size_t panels_;
+  std::vector<float> data_;
+};
+
+// Rows of a panel, a multiple of the SIMD width of every supported ISA. The
+// channel counts of lc0 networks are multiples of it.
+constexpr size_t kPackedGemmRows = 16;
+
+// Column major output = weights x input, where input is weights.depth() x
+// @columns with leading dimension @ldi and output is weights.rows() x @columns
+// with leading dimension @ldo.
+void PackedSgemm(const PackedMatrix& weights, size_t columns,
+                 const float* input, size_t ldi, float* output, size_t ldo);
+
+// Name of the micro-kernel selected for this processor, for logging.
+const char* PackedGemmKernelName();
+
+// Names of the micro-kernels this processor can run, the selected one first.
+std::vector<std::string> PackedGemmKernelNames();
+
+// Same as PackedSgemm(), using the micro-kernel named @kernel. For testing the
+// kernels which are not selected. Throws if it can't run on this processor.
+void PackedSgemmWithKernel(const std::string& kernel,
+                           const PackedMatrix& weights, size_t columns,
+                           const float* input, size_t ldi, float* output,
+                           size_t ldo);
+
+}  // namespace lczero
@@ -0,0 +1,111 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2022 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "neural/blas/packed_gemm.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace lczero {
+namespace {
+
+struct GemmSize {
+  size_t rows;
+  size_t columns;
+  size_t depth;
+};
+
+// Partial panels and tiles, and depths spanning several cache blocks.
+const GemmSize kSizes[] = {{37, 13, 300}, {16, 6, 256}, {5, 1, 3},
+                           {64, 20, 600}, {83, 7, 513}};
+
+// Checks every kernel which can run here against a naive GEMM, with the
+// weights packed both from row major and from column major storage.
+void CheckKernels(const GemmSize& size, bool transposed) {
+  const size_t ldi = size.depth + 3;
+  const size_t ldo = size.rows + 5;
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> weights(size.rows * size.depth);
+  for (auto& w : weights) w = dist(gen);
+  std::vector<float> input(ldi * size.columns);
+  for (auto& x : input) x = dist(gen);
+
+  const PackedMatrix packed =
+      transposed
+          ? PackedMatrix(weights.data(), size.rows, size.depth, 1, size.rows)
+          : PackedMatrix(weights.data(), size.rows, size.depth, size.depth, 1);
+  auto weight = [&](size_t r, size_t d) {
+    return transposed ? weights[d * size.rows + r]
+                      : weights[r * size.depth + d];
+  };
+
+  for (const auto& kernel : PackedGemmKernelNames()) {
+    SCOPED_TRACE(kernel);
+    // Untouched padding shows writes outside the output.
+    std::vector<float> output(ldo * size.columns, 42.0f);
+    PackedSgemmWithKernel(kernel, packed, size.columns, input.data(), ldi,
+                          output.data(), ldo);
+    for (size_t c = 0; c < size.columns; c++) {
+      for (size_t r = 0; r < ldo; r++) {
+        const float result = output[c * ldo + r];
+        if (r >= size.rows) {
+          ASSERT_EQ(result, 42.0f) << "row " << r << " column " << c;
+          continue;
+        }
+        double expected = 0.0;
+        double magnitude = 0.0;
+        for (size_t d = 0; d < size.depth; d++) {
+          const double product = weight(r, d) * input[c * ldi + d];
+          expected += product;
+          magnitude += std::abs(product);
+        }
+        ASSERT_NEAR(result, expected, 1e-5 * magnitude + 1e-6)
+            << "row " << r << " column " << c;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PackedGemm, MatchesNaiveGemm) {
+  for (const auto& size : kSizes) {
+    SCOPED_TRACE(testing::Message() << size.rows << "x" << size.depth << " x "
+                                    << size.depth << "x" << size.columns);
+    CheckKernels(size, false);
+    CheckKernels(size, true);
+  }
+}
+
+TEST(PackedGemm, SelectedKernelIsListedFirst) {
+  const auto names = PackedGemmKernelNames();
+  ASSERT_FALSE(names.empty());
+  EXPECT_EQ(names.front(), PackedGemmKernelName());
+  EXPECT_EQ(names.back(), "generic");
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -63,17 +63,15 @@ static void apply_se(const size_t channels, const size_t batch_size,
 }
 
 template <bool use_eigen>
-void ApplySEUnit(const size_t batch_size, const size_t channels,
-                 const size_t se_fc_outputs, const float* input,
-                 const float* ch_bias, const float* residual,
-                 const float* weights_w1, const float* weights_b1,
-                 const float* weights_w2, const float* weights_b2,
-                 float* output, const ActivationFunction activation) {
-  std::vector<float> pool(2 * channels * batch_size);
+static void se_unit(const size_t batch_size, const size_t channels,
+                    const size_t se_fc_outputs, const float* input,
+                    const float* ch_bias, const float* residual,
+                    const float* weights_w1, const float* weights_b1,
+                    const float* weights_w2, const float* weights_b2,
+                    float* output, const ActivationFunction activation,
+                    std::vector<float>& pool) {
   std::vector<float> fc_out1(batch_size * se_fc_outputs);
 
-  global_avg_pooling(batch_size, channels, input, ch_bias, pool.data());
-
   FullyConnectedLayer<use_eigen>::Forward1D(batch_size, channels, se_fc_outputs,
                                             pool.data(), weights_w1, weights_b1,
                                             activation,  // Activation On
@@ -90,6 +88,43 @@ void ApplySEUnit(const size_t batch_size, const size_t channels,
            activation);
 }
 
+template <bool use_eigen>
+void ApplySEUnit(const size_t batch_size, const size_t channels,
+                 const size_t se_fc_outputs, const float* input,
+                 const float* ch_bias, const float* residual,
+                 const float* weights_w1, const float* weights_b1,
+                 const float* weights_w2, const float* weights_b2,
+                 float* output, const ActivationFunction activation) {
+  std::vector<float> pool(2 * channels * batch_size);
+
+  global_avg_pooling(batch_size, channels, input, ch_bias, pool.data());
+
+  se_unit<use_eigen>(batch_size, channels, se_fc_outputs, input, ch_bias,
+                     residual, weights_w1, weights_b1, weights_w2, weights_b2,
+                     output, activation, pool);
+}
+
+template <bool use_eigen>
+void ApplySEUnit(const size_t batch_size, const size_t channels,
+                 const size_t se_fc_outputs, const float* input,
+                 const float* pooled, const float* ch_bias,
+                 const float* residual, const float* weights_w1,
+                 const float* weights_b1, const float* weights_w2,
+                 const float* weights_b2, float* output,
+                 const ActivationFunction activation) {
+  std::vector<float> pool(2 * channels * batch_size);
+
+  for (auto b = size_t{0}; b < batch_size; b++) {
+    for (auto ch = size_t{0}; ch < channels; ch++) {
+      pool[b * channels + ch] = pooled[b * channels + ch] + ch_bias[ch];
+    }
+  }
+
+  se_unit<use_eigen>(batch_size, channels, se_fc_outputs, input, ch_bias,
+                     residual, weights_w1, weights_b1, weights_w2, weights_b2,
+                     output, activation, pool);
+}
+
 template void ApplySEUnit<true>(const size_t batch_size, const size_t channels,
                                 const size_t se_fc_outputs, const float* input,
                                 const float* bias, const float* residual,
@@ -98,6 +133,14 @@ template void ApplySEUnit<true>(const size_t batch_size, const size_t channels,
                                 const float* weights_w2,
                                 const float* weights_b2, float* output,
                                 const ActivationFunction activation);
+template void ApplySEUnit<true>(const size_t batch_size, const size_t channels,
+                                const size_t se_fc_outputs, const float* input,
+                                const float* pooled, const float* bias,
+                                const float* residual, const float* weights_w1,
+                                const float* weights_b1,
+                                const float* weights_w2,
+                                const float* weights_b2, float* output,
+                                const ActivationFunction activation);
 #ifdef USE_BLAS
 template void ApplySEUnit<false>(const size_t batch_size, const size_t channels,
                                  const size_t se_fc_outputs, const float* input,
@@ -107,5 +150,13 @@ template void ApplySEUnit<false>(const size_t batch_size, const size_t channels,
                                  const float* weights_w2,
                                  const float* weights_b2, float* output,
                                  const ActivationFunction activation);
+template void ApplySEUnit<false>(const size_t batch_size, const size_t channels,
+                                 const size_t se_fc_outputs, const float* input,
+                                 const float* pooled, const float* bias,
+                                 const float* residual, const float* weights_w1,
+                                 const float* weights_b1,
+                                 const float* weights_w2,
+                                 const float* weights_b2, float* output,
+                                 const ActivationFunction activation);
 #endif
 }  // namespace lczero
@@ -32,4 +32,14 @@ void ApplySEUnit(const size_t batch_size, const size_t channels,
                  const float* weights_w2, const float* weights_b2,
                  float* output, const ActivationFunction activation);
 
+// Same as above, with the per channel averages of @input (without @bias)
+// already computed in @pooled, e.g. by WinogradConvolution3::ForwardPooled().
+template <bool use_eigen>
+void ApplySEUnit(const size_t batch_size, const size_t channels,
+                 const size_t se_fc_outputs, const float* input,
+                 const float* pooled, const float* bias, const float* residual,
+                 const float* weights_w1, const float* weights_b1,
+                 const float* weights_w2, const float* weights_b2,
+                 float* output, const ActivationFunction activation);
+
 }  // namespace lczero
@@ -0,0 +1,121 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "neural/blas/weights_storage.h"
+
+#include "neural/shared/weights_cache.h"
+#include "utils/exception.h"
+#include "utils/fp16_utils.h"
+
+namespace lczero {
+
+WeightsPrecision ParseWeightsPrecision(const std::string& name) {
+  if (name == "fp32") return WeightsPrecision::kFP32;
+  if (name == "fp16") return WeightsPrecision::kFP16;
+  if (name == "bf16") return WeightsPrecision::kBF16;
+  throw Exception("Unknown weights precision " + name +
+                  ", should be one of fp32, fp16 or bf16.");
+}
+
+const char* WeightsPrecisionName(WeightsPrecision precision) {
+  switch (precision) {
+    case WeightsPrecision::kFP16:
+      return "fp16";
+    case WeightsPrecision::kBF16:
+      return "bf16";
+    case WeightsPrecision::kFP32:
+      break;
+  }
+  return "fp32";
+}
+
+WeightsStorage::WeightsStorage(std::vector<float>&& weights,
+                               WeightsPrecision precision)
+    : precision_(precision), size_(weights.size()) {
+  switch (precision_) {
+    case WeightsPrecision::kFP32:
+      fp32_ = std::move(weights);
+      return;
+    case WeightsPrecision::kFP16:
+      half_.resize(size_);
+      FP32toFP16(weights.data(), half_.data(), size_);
+      break;
+    case WeightsPrecision::kBF16:
+      half_.resize(size_);
+      FP32toBF16(weights.data(), half_.data(), size_);
+      break;
+  }
+  // Release the fp32 copy, it is not needed anymore.
+  std::vector<float>().swap(weights);
+}
+
+WeightsStorage::WeightsStorage(BlobReader* reader)
+    : precision_(static_cast<WeightsPrecision>(reader->Read<uint32_t>())),
+      size_(reader->Read<uint64_t>()),
+      fp32_(reader->ReadVector<float>()),
+      half_(reader->ReadVector<uint16_t>()) {
+  const auto packed = reader->Read<uint64_t>();
+  for (size_t i = 0; i < packed; i++) packed_.emplace_back(reader);
+}
+
+void WeightsStorage::Save(BlobWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(precision_));
+  writer->Write<uint64_t>(size_);
+  writer->Write<uint64_t>(fp32_.size());
+  writer->Write(fp32_.data(), fp32_.size());
+  writer->Write<uint64_t>(half_.size());
+  writer->Write(half_.data(), half_.size());
+  writer->Write<uint64_t>(packed_.size());
+  for (const auto& matrix : packed_) matrix.Save(writer);
+}
+
+size_t WeightsStorage::bytes() const {
+  size_t bytes = fp32_.size() * sizeof(float) + half_.size() * sizeof(uint16_t);
+  for (const auto& matrix : packed_) bytes += matrix.bytes();
+  return bytes;
+}
+
+const float* WeightsStorage::Get(size_t offset, size_t count,
+                                 float* scratch) const {
+  switch (precision_) {
+    case WeightsPrecision::kFP16:
+      FP16toFP32(&half_[offset], scratch, count);
+      return scratch;
+    case WeightsPrecision::kBF16:
+      BF16toFP32(&half_[offset], scratch, count);
+      return scratch;
+    case WeightsPrecision::kFP32:
+      break;
+  }
+  return &fp32_[offset];
+}
+
+void WeightsStorage::Pack(size_t count, size_t rows, size_t depth,
+                          bool row_major) {
+  if (precision_ != WeightsPrecision::kFP32) {
+    throw Exception("Only fp32 weights can be packed for the built-in GEMM.");
+  }
+  for (size_t i = 0; i < count; i++) {
+    packed_.emplace_back(&fp32_[i * rows * depth], rows, depth,
+                         row_major ? depth : 1, row_major ? 1 : rows);
+  }
+  std::vector<float>().swap(fp32_);
+}
+
+}  // namespace lczero
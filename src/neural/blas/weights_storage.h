@@ -0,0 +1,75 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2022 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "neural/blas/packed_gemm.h"
+
+namespace lczero {
+
+enum class WeightsPrecision { kFP32, kFP16, kBF16 };
+
+// Parses "fp32", "fp16" or "bf16", throws on anything else.
+WeightsPrecision ParseWeightsPrecision(const std::string& name);
+const char* WeightsPrecisionName(WeightsPrecision precision);
+
+// A weights tensor kept in fp32, fp16 or bf16. The 16-bit formats halve the
+// memory traffic of streaming the weights through the cache for every batch,
+// at the cost of expanding them back to fp32 right before use. Layers expand
+// one block at a time (a Winograd tile, a few fully connected rows), so the
+// fp32 copy stays in cache.
+class WeightsStorage {
+ public:
+  WeightsStorage() = default;
+  WeightsStorage(std::vector<float>&& weights, WeightsPrecision precision);
+  // Reads a tensor written by Save() from the weights cache.
+  explicit WeightsStorage(BlobReader* reader);
+  void Save(BlobWriter* writer) const;
+
+  WeightsPrecision precision() const { return precision_; }
+  size_t size() const { return size_; }
+  // Memory used by the tensor, in bytes.
+  size_t bytes() const;
+
+  // Returns @count fp32 values starting from @offset. For fp32 storage this is
+  // a pointer into the tensor itself, otherwise the values are expanded into
+  // @scratch, which must have space for @count floats.
+  const float* Get(size_t offset, size_t count, float* scratch) const;
+
+  // Repacks fp32 storage for the built-in GEMM kernels, as @count consecutive
+  // rows x depth matrices, stored column major unless @row_major. Get() can't
+  // be used afterwards.
+  void Pack(size_t count, size_t rows, size_t depth, bool row_major);
+  bool packed() const { return !packed_.empty(); }
+  const PackedMatrix& packed(size_t index) const { return packed_[index]; }
+
+ private:
+  WeightsPrecision precision_ = WeightsPrecision::kFP32;
+  size_t size_ = 0;
+  std::vector<float> fp32_;
+  std::vector<uint16_t> half_;
+  std::vector<PackedMatrix> packed_;
+};
+
+}  // namespace lczero
@@ -39,6 +39,27 @@ template <typename T>
 using ConstEigenMatrixMap =
     Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>;
 
+#ifndef USE_ISPC
+namespace {
+// Calculates transpose(A).m.A for a single Winograd tile, see TransformOut().
+// The outputs are in the order o11, o12, o21, o22.
+inline void TransformTile(const float* m, float* o) {
+  o[0] = m[0 * 4 + 0] + m[0 * 4 + 1] + m[0 * 4 + 2] + m[1 * 4 + 0] +
+         m[1 * 4 + 1] + m[1 * 4 + 2] + m[2 * 4 + 0] + m[2 * 4 + 1] +
+         m[2 * 4 + 2];
+  o[1] = m[0 * 4 + 1] - m[0 * 4 + 2] - m[0 * 4 + 3] + m[1 * 4 + 1] -
+         m[1 * 4 + 2] - m[1 * 4 + 3] + m[2 * 4 + 1] - m[2 * 4 + 2] -
+         m[2 * 4 + 3];
+  o[2] = m[1 * 4 + 0] + m[1 * 4 + 1] + m[1 * 4 + 2] - m[2 * 4 + 0] -
+         m[2 * 4 + 1] - m[2 * 4 + 2] - m[3 * 4 + 0] - m[3 * 4 + 1] -
+         m[3 * 4 + 2];
+  o[3] = m[1 * 4 + 1] - m[1 * 4 + 2] - m[1 * 4 + 3] - m[2 * 4 + 1] +
+         m[2 * 4 + 2] + m[2 * 4 + 3] - m[3 * 4 + 1] + m[3 * 4 + 2] +
+         m[3 * 4 + 3];
+}
+}  // namespace
+#endif
+
 template <bool use_eigen>
 WinogradConvolution3<use_eigen>::WinogradConvolution3(
     const size_t max_batch_size, const size_t max_input_layers,
@@ -58,6 +79,78 @@ void WinogradConvolution3<use_eigen>::Forward(const size_t batch_size,
   TransformOut(batch_size, output, output_channels);
 }
 
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::Forward(const size_t batch_size,
+                                              const size_t input_channels,
+                                              const size_t output_channels,
+                                              const float* input,
+                                              const WeightsStorage& weights,
+                                              float* output) {
+  Multiply(batch_size, input_channels, output_channels, input, weights);
+  TransformOut(batch_size, output, output_channels);
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::Forward(
+    const size_t batch_size, const size_t input_channels,
+    const size_t output_channels, const float* input,
+    const WeightsStorage& weights, const float* biases, const float* residual,
+    const ActivationFunction activation, float* output) {
+  Multiply(batch_size, input_channels, output_channels, input, weights);
+  if (activation != NONE && activation != RELU && activation != MISH) {
+    // Not supported by the fused transform.
+    TransformOut(batch_size, output, output_channels);
+    if (residual) {
+      BiasResidual(batch_size, output_channels, output, biases, residual,
+                   activation);
+    } else {
+      BiasActivate(batch_size, output_channels, output, biases, activation);
+    }
+    return;
+  }
+  TransformOutActivate(batch_size, output, output_channels, biases, residual,
+                       activation);
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::ForwardPooled(
+    const size_t batch_size, const size_t input_channels,
+    const size_t output_channels, const float* input,
+    const WeightsStorage& weights, float* output, float* pooled) {
+  Multiply(batch_size, input_channels, output_channels, input, weights);
+  TransformOutPool(batch_size, output, output_channels, pooled);
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::Multiply(const size_t batch_size,
+                                               const size_t input_channels,
+                                               const size_t output_channels,
+                                               const float* input,
+                                               const WeightsStorage& weights) {
+  TransformIn(batch_size, input, input_channels);
+  if (weights.packed()) {
+    for (size_t b = 0; b < kWinogradTile; b++) {
+      PackedSgemm(weights.packed(b), batch_size * kTiles,
+                  &V_[b * batch_size * input_channels * kTiles],
+                  input_channels,
+                  &M_[b * batch_size * output_channels * kTiles],
+                  output_channels);
+    }
+    return;
+  }
+  if (weights.precision() == WeightsPrecision::kFP32) {
+    Sgemm(batch_size, weights.Get(0, weights.size(), nullptr), input_channels,
+          output_channels);
+    return;
+  }
+  const auto tile_size = output_channels * input_channels;
+  if (W_.size() < tile_size) W_.resize(tile_size);
+  for (size_t b = 0; b < kWinogradTile; b++) {
+    SgemmTile(b, batch_size, weights.Get(b * tile_size, tile_size, W_.data()),
+              input_channels, output_channels);
+  }
+}
+
 template <bool use_eigen>
 void WinogradConvolution3<use_eigen>::TransformIn(const size_t batch_size,
                                                   const float* input,
@@ -161,6 +254,36 @@ void WinogradConvolution3<use_eigen>::TransformIn(const size_t batch_size,
 }
 
 #ifdef USE_BLAS
+template <>
+void WinogradConvolution3<false>::SgemmTile(const size_t b,
+                                            const size_t batch_size,
+                                            const float* tile_weights,
+                                            const size_t input_channels,
+                                            const size_t output_channels) {
+  // In col major
+  //
+  //            M               =         weights(T)        x          V
+  //
+  // cols      tiles                  input_channels              tiles
+  // rows   output_channels          output_channels            input_channels
+
+  auto offset_v = b * batch_size * input_channels * kTiles;
+  auto offset_m = b * batch_size * output_channels * kTiles;
+  cblas_sgemm(CblasColMajor,               // Row major format
+              CblasNoTrans,                // A no trans
+              CblasNoTrans,                // B no trans
+              (int)output_channels,        // rows W, M
+              (int)(batch_size * kTiles),  // cols V, M
+              (int)input_channels,         // cols W, rows V
+              1.0f,                        // alpha
+              tile_weights,                // W
+              (int)output_channels,        // ldW
+              &V_[offset_v],               // V
+              (int)input_channels, 0.0f,   // ldV
+              &M_[offset_m],               // M
+              (int)output_channels);       // ldM
+}
+
 template <>
 void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
                                         const float* weights,
@@ -210,50 +333,38 @@ void WinogradConvolution3<false>::Sgemm(const size_t batch_size,
 #else
 
   for (size_t b = 0; b < kWinogradTile; b++) {
-    auto offset_u = b * output_channels * input_channels;
-
-    // In col major
-    //
-    //            M               =         weights(T)        x          V
-    //
-    // cols      tiles                  input_channels              tiles
-    // rows   output_channels          output_channels            input_channels
-
-    auto offset_v = b * batch_size * input_channels * kTiles;
-    auto offset_m = b * batch_size * output_channels * kTiles;
-    cblas_sgemm(CblasColMajor,               // Row major format
-                CblasNoTrans,                // A no trans
-                CblasNoTrans,                // B no trans
-                (int)output_channels,        // rows W, M
-                (int)(batch_size * kTiles),  // cols V, M
-                (int)input_channels,         // cols W, rows V
-                1.0f,                        // alpha
-                &weights[offset_u],          // W
-                (int)output_channels,        // ldW
-                &V_[offset_v],               // V
-                (int)input_channels, 0.0f,   // ldV
-                &M_[offset_m],               // M
-                (int)output_channels);       // ldM
+    SgemmTile(b, batch_size, &weights[b * output_channels * input_channels],
+              input_channels, output_channels);
   }
 #endif
 }
 #endif
 
+template <>
+void WinogradConvolution3<true>::SgemmTile(const size_t b,
+                                           const size_t batch_size,
+                                           const float* tile_weights,
+                                           const size_t input_channels,
+                                           const size_t output_channels) {
+  auto offset_v = b * batch_size * input_channels * kTiles;
+  auto offset_m = b * batch_size * output_channels * kTiles;
+  auto C_mat = EigenMatrixMap<float>(&M_[offset_m], output_channels,
+                                     batch_size * kTiles);
+  C_mat.noalias() =
+      ConstEigenMatrixMap<float>(tile_weights, output_channels,
+                                 input_channels) *
+      ConstEigenMatrixMap<float>(&V_[offset_v], input_channels,
+                                 batch_size * kTiles);
+}
+
 template <>
 void WinogradConvolution3<true>::Sgemm(const size_t batch_size,
                                        const float* weights,
                                        const size_t input_channels,
                                        const size_t output_channels) {
   for (size_t b = 0; b < kWinogradTile; b++) {
-    auto offset_u = b * output_channels * input_channels;
-    auto offset_v = b * batch_size * input_channels * kTiles;
-    auto offset_m = b * batch_size * output_channels * kTiles;
-    auto C_mat = EigenMatrixMap<float>(&M_[offset_m], output_channels,
-                                       batch_size * kTiles);
-    C_mat.noalias() = ConstEigenMatrixMap<float>(
-                          &weights[offset_u], output_channels, input_channels) *
-                      ConstEigenMatrixMap<float>(&V_[offset_v], input_channels,
-                                                 batch_size * kTiles);
+    SgemmTile(b, batch_size, &weights[b * output_channels * input_channels],
+              input_channels, output_channels);
   }
 }
 
@@ -325,6 +436,116 @@ void WinogradConvolution3<use_eigen>::TransformOut(const size_t batch_size,
 #endif  // USE_ISPC
 }
 
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::TransformOutActivate(
+    const size_t batch_size, float* output, const size_t channels,
+    const float* biases, const float* residual,
+    const ActivationFunction activation) {
+#ifndef USE_ISPC
+
+  float m[kWinogradTile];
+  float o[4];
+
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    const float* M_batch = &M_[channels * kTiles * batch_index];
+    const size_t output_batch = batch_index * kWidth * kHeight * channels;
+
+    for (size_t channel = 0; channel < channels; channel++) {
+      const float* M_channel = M_batch + channel;
+      const size_t output_channel = output_batch + channel * kSquares;
+      const float bias = biases[channel];
+
+      for (int block_x = 0; block_x < kWtiles; block_x++) {
+        for (int block_y = 0; block_y < kWtiles; block_y++) {
+          const auto x = 2 * block_x;
+          const auto y = 2 * block_y;
+
+          const auto b = block_y * kWtiles + block_x;
+          const float* M_wtile = M_channel + channels * b;
+          const auto M_incr = channels * kTiles * batch_size;
+
+          for (int wTile = 0; wTile < kWinogradTile; wTile++) {
+            m[wTile] = *M_wtile;
+            M_wtile += M_incr;
+          }
+          TransformTile(m, o);
+
+          const size_t index[4] = {output_channel + y * kWidth + x,
+                                   output_channel + y * kWidth + x + 1,
+                                   output_channel + (y + 1) * kWidth + x,
+                                   output_channel + (y + 1) * kWidth + x + 1};
+          for (int i = 0; i < 4; i++) {
+            float val = o[i] + bias;
+            if (residual) val += residual[index[i]];
+            output[index[i]] = Activate(val, activation);
+          }
+        }
+      }
+    }
+  }
+
+#else  // USE_ISPC
+
+  ispc::winograd_TransformOutActivate_ispc(
+      batch_size, &M_[0], channels, biases, residual ? residual : biases,
+      residual != nullptr, static_cast<int>(activation), output);
+
+#endif  // USE_ISPC
+}
+
+template <bool use_eigen>
+void WinogradConvolution3<use_eigen>::TransformOutPool(const size_t batch_size,
+                                                       float* output,
+                                                       const size_t channels,
+                                                       float* pooled) {
+#ifndef USE_ISPC
+
+  float m[kWinogradTile];
+  float o[4];
+
+  for (size_t batch_index = 0; batch_index < batch_size; batch_index++) {
+    const float* M_batch = &M_[channels * kTiles * batch_index];
+    float* output_batch = output + batch_index * kWidth * kHeight * channels;
+
+    for (size_t channel = 0; channel < channels; channel++) {
+      const float* M_channel = M_batch + channel;
+      float* output_channel = output_batch + channel * (kHeight * kWidth);
+      float sum = 0.0f;
+
+      for (int block_x = 0; block_x < kWtiles; block_x++) {
+        for (int block_y = 0; block_y < kWtiles; block_y++) {
+          const auto x = 2 * block_x;
+          const auto y = 2 * block_y;
+
+          const auto b = block_y * kWtiles + block_x;
+          const float* M_wtile = M_channel + channels * b;
+          const auto M_incr = channels * kTiles * batch_size;
+
+          for (int wTile = 0; wTile < kWinogradTile; wTile++) {
+            m[wTile] = *M_wtile;
+            M_wtile += M_incr;
+          }
+          TransformTile(m, o);
+
+          output_channel[(y)*kWidth + (x)] = o[0];
+          output_channel[(y)*kWidth + (x + 1)] = o[1];
+          output_channel[(y + 1) * kWidth + (x)] = o[2];
+          output_channel[(y + 1) * kWidth + (x + 1)] = o[3];
+          sum += o[0] + o[1] + o[2] + o[3];
+        }
+      }
+      pooled[batch_index * channels + channel] = sum / kSquares;
+    }
+  }
+
+#else  // USE_ISPC
+
+  ispc::winograd_TransformOutPool_ispc(batch_size, &M_[0], channels, output,
+                                       pooled);
+
+#endif  // USE_ISPC
+}
+
 template class WinogradConvolution3<true>;
 #ifdef USE_BLAS
 template class WinogradConvolution3<false>;
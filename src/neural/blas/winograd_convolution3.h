@@ -21,6 +21,9 @@
 #include <cstddef>
 #include <vector>
 
+#include "neural/blas/weights_storage.h"
+#include "neural/shared/activation.h"
+
 namespace lczero {
 
 // Convolution 3x3 on a 8x8 board using the Winograd algorithm.
@@ -49,6 +52,28 @@ class WinogradConvolution3 {
                const size_t output_channels, const float* input,
                const float* weights, float* output);
 
+  // Same as above, with the weights expanded to fp32 one tile at a time when
+  // they are stored in reduced precision.
+  void Forward(const size_t batch_size, const size_t input_channels,
+               const size_t output_channels, const float* input,
+               const WeightsStorage& weights, float* output);
+
+  // Forward inference with the bias, the @residual (unless null) and the
+  // activation applied by the output transform, so that the convolution
+  // output goes through memory only once.
+  void Forward(const size_t batch_size, const size_t input_channels,
+               const size_t output_channels, const float* input,
+               const WeightsStorage& weights, const float* biases,
+               const float* residual, const ActivationFunction activation,
+               float* output);
+
+  // Forward inference that also stores the average of every output channel
+  // (batch_size x output_channels) in @pooled, as needed by an SE unit.
+  void ForwardPooled(const size_t batch_size, const size_t input_channels,
+                     const size_t output_channels, const float* input,
+                     const WeightsStorage& weights, float* output,
+                     float* pooled);
+
  private:
   void TransformIn(const size_t batch_size, const float* input,
                    const size_t channels);
@@ -56,9 +81,27 @@ class WinogradConvolution3 {
   void Sgemm(const size_t batch_size, const float* weights,
              const size_t input_channels, const size_t output_channels);
 
+  // Multiplies the weights of a single Winograd tile.
+  void SgemmTile(const size_t tile, const size_t batch_size,
+                 const float* tile_weights, const size_t input_channels,
+                 const size_t output_channels);
+
   void TransformOut(const size_t batch_size, float* output,
                     const size_t channels);
 
+  void TransformOutActivate(const size_t batch_size, float* output,
+                            const size_t channels, const float* biases,
+                            const float* residual,
+                            const ActivationFunction activation);
+
+  void TransformOutPool(const size_t batch_size, float* output,
+                        const size_t channels, float* pooled);
+
+  // Input transform and multiplication, leaving the result in M_.
+  void Multiply(const size_t batch_size, const size_t input_channels,
+                const size_t output_channels, const float* input,
+                const WeightsStorage& weights);
+
   static constexpr auto kWidth = 8;
   static constexpr auto kHeight = 8;
   static constexpr auto kSquares = kWidth * kHeight;
@@ -71,5 +114,7 @@ class WinogradConvolution3 {
 
   std::vector<float> V_;
   std::vector<float> M_;
+  // Scratch space for the fp32 weights of one tile.
+  std::vector<float> W_;
 };
 }  // namespace lczero
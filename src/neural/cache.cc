@@ -30,8 +30,8 @@
 
 namespace lczero {
 CachingComputation::CachingComputation(
-    std::unique_ptr<NetworkComputation> parent, NNCache* cache)
-    : parent_(std::move(parent)), cache_(cache) {}
+    std::unique_ptr<NetworkComputation> parent, NNCache* cache, bool cascade)
+    : parent_(std::move(parent)), cache_(cache), cascade_(cascade) {}
 
 int CachingComputation::GetCacheMisses() const {
   return parent_->GetBatchSize();
@@ -41,7 +41,7 @@ int CachingComputation::GetBatchSize() const { return batch_.size(); }
 
 bool CachingComputation::AddInputByHash(uint64_t hash) {
   NNCacheLock lock(cache_, hash);
-  if (!lock) return false;
+  if (!lock || (lock->cascade && !cascade_)) return false;
   AddInputByHash(hash, std::move(lock));
   return true;
 }
@@ -66,9 +66,18 @@ void CachingComputation::AddInput(
   if (AddInputByHash(hash)) return;
   batch_.emplace_back();
   batch_.back().hash = hash;
-  batch_.back().idx_in_parent = parent_->GetBatchSize();
+  // Positions occurring twice in a batch (e.g. transpositions) are only
+  // computed once.
+  const auto [iter, inserted] =
+      parent_idx_.emplace(hash, parent_->GetBatchSize());
+  batch_.back().idx_in_parent = iter->second;
+  if (!inserted) {
+    batch_.back().duplicate = true;
+    return;
+  }
   batch_.back().probabilities_to_cache = probabilities_to_cache;
-  parent_->AddInput(std::move(input));
+  parent_->AddInputWithPolicyIndices(std::move(input),
+                                     std::move(probabilities_to_cache));
 }
 
 void CachingComputation::PopLastInputHit() {
@@ -83,18 +92,23 @@ void CachingComputation::ComputeBlocking() {
 
   // Fill cache with data from NN.
   for (const auto& item : batch_) {
-    if (item.idx_in_parent == -1) continue;
+    if (item.idx_in_parent == -1 || item.duplicate) continue;
     auto req =
         std::make_unique<CachedNNRequest>(item.probabilities_to_cache.size());
     req->q = parent_->GetQVal(item.idx_in_parent);
     req->d = parent_->GetDVal(item.idx_in_parent);
     req->m = parent_->GetMVal(item.idx_in_parent);
+    req->cascade = cascade_;
     int idx = 0;
     for (auto x : item.probabilities_to_cache) {
       req->p[idx++] =
           std::make_pair(x, parent_->GetPVal(item.idx_in_parent, x));
     }
-    cache_->Insert(item.hash, std::move(req));
+    if (cascade_) {
+      cache_->Insert(item.hash, std::move(req));
+    } else {
+      cache_->Replace(item.hash, std::move(req));
+    }
   }
 }
 
@@ -26,6 +26,8 @@
 */
 #pragma once
 
+#include <unordered_map>
+
 #include "neural/network.h"
 #include "utils/cache.h"
 #include "utils/smallarray.h"
@@ -38,6 +40,9 @@ struct CachedNNRequest {
   float q;
   float d;
   float m;
+  // Computed by the cascade network, to be replaced by the main network's
+  // result if the position turns out to matter.
+  bool cascade = false;
   // TODO(mooskagh) Don't really need index if using perfect hash.
   SmallArray<IdxAndProb> p;
 };
@@ -48,10 +53,14 @@ typedef HashKeyedCacheLock<CachedNNRequest> NNCacheLock;
 // Wraps around NetworkComputation and caches result.
 // While it mostly repeats NetworkComputation interface, it's not derived
 // from it, as AddInput() needs hash and index of probabilities to store.
+//
+// A computation of the cascade network (@cascade) accepts any cached result,
+// and marks the ones it stores. Other computations ignore those and replace
+// them with their own.
 class CachingComputation {
  public:
   CachingComputation(std::unique_ptr<NetworkComputation> parent,
-                     NNCache* cache);
+                     NNCache* cache, bool cascade = false);
 
   // How many inputs are not found in cache and will be forwarded to a wrapped
   // computation.
@@ -72,6 +81,11 @@ class CachingComputation {
   // Undos last AddInput. If it was a cache miss, the it's actually not removed
   // from parent's batch.
   void PopLastInputHit();
+  // Tells the backend when the results are needed, see
+  // NetworkComputation::SetDeadline().
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) {
+    parent_->SetDeadline(deadline);
+  }
   // Do the computation.
   void ComputeBlocking();
   // Returns Q value of @sample.
@@ -87,20 +101,28 @@ class CachingComputation {
   void PopCacheHit();
 
   // Can be used to avoid repeated reallocations internally while adding itemms.
-  void Reserve(int batch_size) { batch_.reserve(batch_size); }
+  void Reserve(int batch_size) {
+    batch_.reserve(batch_size);
+    parent_idx_.reserve(batch_size);
+  }
 
  private:
   struct WorkItem {
     uint64_t hash;
     NNCacheLock lock;
     int idx_in_parent = -1;
+    // Same position as an earlier item of the batch, shares its result.
+    bool duplicate = false;
     std::vector<uint16_t> probabilities_to_cache;
     mutable int last_idx = 0;
   };
 
   std::unique_ptr<NetworkComputation> parent_;
   NNCache* cache_;
+  bool cascade_;
   std::vector<WorkItem> batch_;
+  // Index in the parent of every hash sent there.
+  std::unordered_map<uint64_t, int> parent_idx_;
 };
 
 }  // namespace lczero
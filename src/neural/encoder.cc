@@ -227,7 +227,7 @@ InputPlanes EncodePositionForNN(
        ++i, --history_idx) {
     const Position& position =
         history.GetPositionAt(history_idx < 0 ? 0 : history_idx);
-    const ChessBoard& board =
+    const ChessBoard board =
         flip ? position.GetThemBoard() : position.GetBoard();
     // Castling changes can't be repeated, so we can stop early.
     if (stop_early && board.castlings().as_int() != castlings.as_int()) break;
@@ -111,7 +111,11 @@ bool NetworkFactory::BackendConfiguration::operator==(
 
 std::unique_ptr<Network> NetworkFactory::LoadNetwork(
     const OptionsDict& options) {
-  std::string net_path = options.Get<std::string>(kWeightsId);
+  return LoadNetwork(options, options.Get<std::string>(kWeightsId));
+}
+
+std::unique_ptr<Network> NetworkFactory::LoadNetwork(const OptionsDict& options,
+                                                     std::string net_path) {
   const std::string backend = options.Get<std::string>(kBackendId);
   const std::string backend_options =
       options.Get<std::string>(kBackendOptionsId);
@@ -69,6 +69,9 @@ class NetworkFactory {
   // Helper function to load the network from the options. Returns nullptr
   // if no network options changed since the previous call.
   static std::unique_ptr<Network> LoadNetwork(const OptionsDict& options);
+  // Same, with the weights from @net_path instead of the weights option.
+  static std::unique_ptr<Network> LoadNetwork(const OptionsDict& options,
+                                              std::string net_path);
 
   // Parameter IDs.
   static const OptionId kWeightsId;
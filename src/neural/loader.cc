@@ -34,8 +34,10 @@
 #include <cctype>
 #include <cstdio>
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 #include "proto/net.pb.h"
 #include "utils/commandline.h"
@@ -100,10 +102,22 @@ std::string DecompressGzip(const std::string& filename) {
     }
   }
   gzclose(file);
+  // The weights borrow from the buffer for as long as they live, don't keep
+  // the unused part of the last doubling around.
+  buffer.shrink_to_fit();
 
   return buffer;
 }
 
+// Checks for the gzip magic bytes at the start of the file.
+bool IsGzipCompressed(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) throw Exception("Cannot read weights from " + filename);
+  char magic[2] = {};
+  file.read(magic, 2);
+  return file.gcount() == 2 && magic[0] == '\x1f' && magic[1] == '\x8b';
+}
+
 void FixOlderWeightsFile(WeightsFile* file) {
   using nf = pblczero::NetworkFormat;
   auto network_format = file->format().network_format().network();
@@ -135,9 +149,23 @@ void FixOlderWeightsFile(WeightsFile* file) {
   }
 }
 
-WeightsFile ParseWeightsProto(const std::string& buffer) {
+// Bytes fields of the result reference the buffer and keep @owner alive.
+WeightsFile ParseWeightsProto(std::string_view buffer,
+                              std::shared_ptr<const void> owner) {
+  if (buffer.size() < 2) {
+    throw Exception("Invalid weight file: too small.");
+  }
+  if (buffer[0] == '1' && buffer[1] == '\n') {
+    throw Exception("Invalid weight file: no longer supported.");
+  }
+  if (buffer[0] == '2' && buffer[1] == '\n') {
+    throw Exception(
+        "Text format weights files are no longer supported. Use a command line "
+        "tool to convert it to the new format.");
+  }
+
   WeightsFile net;
-  net.ParseFromString(buffer);
+  net.ParseFromBorrowedString(buffer, std::move(owner));
 
   if (net.magic() != kWeightMagic) {
     throw Exception("Invalid weight file: bad header.");
@@ -170,22 +198,15 @@ WeightsFile ParseWeightsProto(const std::string& buffer) {
 }  // namespace
 
 WeightsFile LoadWeightsFromFile(const std::string& filename) {
-  FloatVectors vecs;
-  auto buffer = DecompressGzip(filename);
-
-  if (buffer.size() < 2) {
-    throw Exception("Invalid weight file: too small.");
-  }
-  if (buffer[0] == '1' && buffer[1] == '\n') {
-    throw Exception("Invalid weight file: no longer supported.");
+  if (filename != CommandLine::BinaryName() && !IsGzipCompressed(filename)) {
+    // Uncompressed network, the layers can point directly into the mapping.
+    auto mapped = std::make_shared<MappedFile>(filename);
+    const auto data = mapped->data();
+    return ParseWeightsProto(data, std::move(mapped));
   }
-  if (buffer[0] == '2' && buffer[1] == '\n') {
-    throw Exception(
-        "Text format weights files are no longer supported. Use a command line "
-        "tool to convert it to the new format.");
-  }
-
-  return ParseWeightsProto(buffer);
+  auto buffer = std::make_shared<const std::string>(DecompressGzip(filename));
+  const std::string_view data = *buffer;
+  return ParseWeightsProto(data, std::move(buffer));
 }
 
 std::string DiscoverWeightsFile() {
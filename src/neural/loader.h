@@ -40,7 +40,9 @@ using FloatVectors = std::vector<FloatVector>;
 
 using WeightsFile = pblczero::Net;
 
-// Read weights file and fill the weights structure.
+// Read weights file and fill the weights structure. Uncompressed files (e.g. a
+// gunzipped .pb.gz) are memory mapped, and the layers of the result reference
+// the mapping instead of holding a copy.
 WeightsFile LoadWeightsFromFile(const std::string& filename);
 
 // Tries to find a file which looks like a weights file, and located in
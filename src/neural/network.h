@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -57,6 +58,14 @@ class NetworkComputation {
  public:
   // Adds a sample to the batch.
   virtual void AddInput(InputPlanes&& input) = 0;
+  // Same, telling that only the policy outputs at @policy_indices (usually
+  // those of the legal moves) will be queried. Backends may then skip
+  // computing the other ones, GetPVal() of which becomes unspecified. An empty
+  // list means that all of them may be queried.
+  virtual void AddInputWithPolicyIndices(
+      InputPlanes&& input, std::vector<uint16_t> /*policy_indices*/) {
+    AddInput(std::move(input));
+  }
   // Do the computation.
   virtual void ComputeBlocking() = 0;
   // Returns how many times AddInput() was called.
@@ -67,6 +76,11 @@ class NetworkComputation {
   // Returns P value @move_id of @sample.
   virtual float GetPVal(int sample, int move_id) const = 0;
   virtual float GetMVal(int sample) const = 0;
+  // Tells that the results are needed by @deadline. Backends that hold
+  // computations back to form larger batches use it to shorten the delay,
+  // others ignore it. Must be called before ComputeBlocking().
+  virtual void SetDeadline(
+      std::chrono::steady_clock::time_point /*deadline*/) {}
   virtual ~NetworkComputation() = default;
 };
 
@@ -25,49 +25,62 @@
   Program grant you additional permission to convey the resulting work.
 */
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
-#include <queue>
+#include <deque>
 #include <thread>
 
 #include "neural/factory.h"
 #include "utils/exception.h"
+#include "utils/logging.h"
 #include "utils/numa.h"
 
 namespace lczero {
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
 class DemuxingNetwork;
 class DemuxingComputation : public NetworkComputation {
  public:
   DemuxingComputation(DemuxingNetwork* network) : network_(network) {}
 
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithPolicyIndices(std::move(input), {});
+  }
+
+  void AddInputWithPolicyIndices(
+      InputPlanes&& input, std::vector<uint16_t> policy_indices) override {
+    planes_.emplace_back(std::move(input));
+    policy_indices_.emplace_back(std::move(policy_indices));
+  }
 
   void ComputeBlocking() override;
 
   int GetBatchSize() const override { return planes_.size(); }
 
   float GetQVal(int sample) const override {
-    const int idx = sample / partial_size_;
-    const int offset = sample % partial_size_;
+    const int idx = sample_parent_[sample];
+    const int offset = sample - parent_start_[idx];
     return parents_[idx]->GetQVal(offset);
   }
 
   float GetDVal(int sample) const override {
-    int idx = sample / partial_size_;
-    int offset = sample % partial_size_;
+    const int idx = sample_parent_[sample];
+    const int offset = sample - parent_start_[idx];
     return parents_[idx]->GetDVal(offset);
   }
 
   float GetMVal(int sample) const override {
-    int idx = sample / partial_size_;
-    int offset = sample % partial_size_;
+    const int idx = sample_parent_[sample];
+    const int offset = sample - parent_start_[idx];
     return parents_[idx]->GetMVal(offset);
   }
 
   float GetPVal(int sample, int move_id) const override {
-    const int idx = sample / partial_size_;
-    const int offset = sample % partial_size_;
+    const int idx = sample_parent_[sample];
+    const int offset = sample - parent_start_[idx];
     return parents_[idx]->GetPVal(offset, move_id);
   }
 
@@ -79,30 +92,45 @@ class DemuxingComputation : public NetworkComputation {
     }
   }
 
-  NetworkComputation* AddParentFromNetwork(Network* network) {
+  // Creates the computation of chunk @idx in @network and fills it with the
+  // samples of the chunk.
+  NetworkComputation* AddParentFromNetwork(Network* network, int idx) {
     std::unique_lock<std::mutex> lock(mutex_);
-    parents_.emplace_back(network->NewComputation());
-    const int cur_idx = (parents_.size() - 1) * partial_size_;
-    for (int i = cur_idx; i < std::min(GetBatchSize(), cur_idx + partial_size_);
-         i++) {
-      parents_.back()->AddInput(std::move(planes_[i]));
+    parents_[idx] = network->NewComputation();
+    const int end = idx + 1 < static_cast<int>(parent_start_.size())
+                        ? parent_start_[idx + 1]
+                        : GetBatchSize();
+    for (int i = parent_start_[idx]; i < end; i++) {
+      parents_[idx]->AddInputWithPolicyIndices(std::move(planes_[i]),
+                                               std::move(policy_indices_[i]));
     }
-    return parents_.back().get();
+    return parents_[idx].get();
   }
 
  private:
   std::vector<InputPlanes> planes_;
+  std::vector<std::vector<uint16_t>> policy_indices_;
   DemuxingNetwork* network_;
   std::vector<std::unique_ptr<NetworkComputation>> parents_;
+  // First sample of every chunk, and the chunk of every sample.
+  std::vector<int> parent_start_;
+  std::vector<int> sample_parent_;
 
   std::mutex mutex_;
   std::condition_variable dataready_cv_;
   int dataready_ = 0;
-  int partial_size_ = 0;
 };
 
 class DemuxingNetwork : public Network {
  public:
+  // A part of a batch, to be computed preferably by @child.
+  struct Chunk {
+    DemuxingComputation* computation;
+    int index;
+    int size;
+    int child;
+  };
+
   DemuxingNetwork(const std::optional<WeightsFile>& weights,
                   const OptionsDict& options) {
     minimum_split_size_ = options.GetOrDefault<int>("minimum-split-size", 0);
@@ -125,17 +153,22 @@ class DemuxingNetwork : public Network {
     const int nn_threads = opts.GetOrDefault<int>("threads", 1);
     const std::string backend = opts.GetOrDefault<std::string>("backend", name);
 
-    networks_.emplace_back(
-        NetworkFactory::Get()->Create(backend, weights, opts));
+    auto child = std::make_unique<Child>();
+    child->name = name == backend ? name : backend + " " + name;
+    child->network = NetworkFactory::Get()->Create(backend, weights, opts);
+    child->threads = nn_threads;
+    children_.push_back(std::move(child));
 
-    if (networks_.size() == 1) {
-      capabilities_ = networks_.back()->GetCapabilities();
+    if (children_.size() == 1) {
+      capabilities_ = children_.back()->network->GetCapabilities();
     } else {
-      capabilities_.Merge(networks_.back()->GetCapabilities());
+      capabilities_.Merge(children_.back()->network->GetCapabilities());
     }
 
+    const int child_idx = children_.size() - 1;
     for (int i = 0; i < nn_threads; ++i) {
-      threads_.emplace_back([this, i]() { Worker(i); });
+      const int id = threads_.size();
+      threads_.emplace_back([this, child_idx, id]() { Worker(child_idx, id); });
     }
   }
 
@@ -147,10 +180,58 @@ class DemuxingNetwork : public Network {
     return capabilities_;
   }
 
-  void Enqueue(DemuxingComputation* computation) {
+  // Splits a batch into chunks, one for every worker thread, sized in
+  // proportion to the measured throughput of its backend. When
+  // minimum-split-size doesn't allow as many chunks, the fastest threads get
+  // them. Returns the chunk sizes and their preferred backends.
+  std::vector<std::pair<int, int>> Split(int batch_size) {
+    std::vector<std::pair<double, int>> threads;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Until every backend was measured, all threads get equal parts.
+      bool measured = true;
+      for (const auto& child : children_) {
+        measured = measured && child->throughput > 0.0;
+      }
+      for (size_t i = 0; i < children_.size(); i++) {
+        for (int j = 0; j < children_[i]->threads; j++) {
+          threads.emplace_back(measured ? children_[i]->throughput : 1.0, i);
+        }
+      }
+    }
+    std::stable_sort(
+        threads.begin(), threads.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+    size_t splits = threads.size();
+    if (minimum_split_size_ > 0) {
+      splits = std::min<size_t>(
+          splits, std::max(1, batch_size / minimum_split_size_));
+    }
+    threads.resize(splits);
+
+    double total = 0.0;
+    for (const auto& thread : threads) total += thread.first;
+    std::vector<std::pair<int, int>> chunks;
+    int assigned = 0;
+    double cumulative = 0.0;
+    for (const auto& thread : threads) {
+      cumulative += thread.first;
+      // Rounding the cumulative share keeps the sizes summing to the batch.
+      const int end = static_cast<int>(batch_size * cumulative / total + 0.5);
+      if (end > assigned) chunks.emplace_back(end - assigned, thread.second);
+      assigned = std::max(assigned, end);
+    }
+    if (assigned < batch_size) {
+      if (chunks.empty()) chunks.emplace_back(0, threads[0].second);
+      chunks.back().first += batch_size - assigned;
+    }
+    return chunks;
+  }
+
+  void Enqueue(const Chunk& chunk) {
     std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(computation);
-    cv_.notify_one();
+    queue_.push_back(chunk);
+    cv_.notify_all();
   }
 
   ~DemuxingNetwork() {
@@ -158,40 +239,53 @@ class DemuxingNetwork : public Network {
     Wait();
     // Unstuck waiting computations.
     while (!queue_.empty()) {
-      queue_.front()->NotifyComplete();
-      queue_.pop();
+      queue_.front().computation->NotifyComplete();
+      queue_.pop_front();
     }
   }
 
-  void Worker(int id) {
+  void Worker(int child_idx, int id) {
     // Add one to the id in order to leave space for an active search thread.
     Numa::BindThread(id + 1);
+    Child* child = children_[child_idx].get();
     // While Abort() is not called (and it can only be called from destructor).
     while (!abort_) {
+      Chunk chunk;
       {
-        {
-          std::unique_lock<std::mutex> lock(mutex_);
-          // Wait until there's come work to compute.
-          cv_.wait(lock, [&] { return abort_ || !queue_.empty(); });
-          if (abort_) break;
-        }
-
-        // While there is a work in queue, process it.
-        while (true) {
-          DemuxingComputation* to_notify;
-          {
-            std::unique_lock<std::mutex> lock(mutex_);
-            if (queue_.empty()) break;
-            to_notify = queue_.front();
-            queue_.pop();
-          }
-          long long net_idx = ++(counter_) % networks_.size();
-          NetworkComputation* to_compute =
-              to_notify->AddParentFromNetwork(networks_[net_idx].get());
-          to_compute->ComputeBlocking();
-          to_notify->NotifyComplete();
-        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Wait until there's come work to compute.
+        auto iter = queue_.end();
+        child->idle_threads++;
+        cv_.wait(lock, [&] {
+          if (abort_) return true;
+          iter = FindChunk(child_idx);
+          return iter != queue_.end();
+        });
+        child->idle_threads--;
+        if (abort_) break;
+        chunk = *iter;
+        queue_.erase(iter);
+        // The other chunks of this backend may be stolen now.
+        if (child->idle_threads == 0) cv_.notify_all();
       }
+
+      const auto start = Clock::now();
+      NetworkComputation* to_compute = chunk.computation->AddParentFromNetwork(
+          child->network.get(), chunk.index);
+      to_compute->ComputeBlocking();
+      const std::chrono::duration<double> elapsed = Clock::now() - start;
+      chunk.computation->NotifyComplete();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Exponential average of samples per second of one thread.
+      constexpr double kAlpha = 0.1;
+      const double throughput = chunk.size / std::max(elapsed.count(), 1e-6);
+      child->throughput = child->throughput > 0.0
+                              ? (1.0 - kAlpha) * child->throughput +
+                                    kAlpha * throughput
+                              : throughput;
+      child->samples += chunk.size;
+      ReportShares();
     }
   }
 
@@ -210,11 +304,58 @@ class DemuxingNetwork : public Network {
     }
   }
 
-  std::vector<std::unique_ptr<Network>> networks_;
+ private:
+  struct Child {
+    std::string name;
+    std::unique_ptr<Network> network;
+    int threads = 0;
+    // Samples per second of one thread. Guarded by mutex_.
+    double throughput = 0.0;
+    // Samples computed since the last report. Guarded by mutex_.
+    int64_t samples = 0;
+    // Threads waiting for a chunk. Guarded by mutex_.
+    int idle_threads = 0;
+  };
+
+  // Returns the chunk a thread of @child_idx should compute, if any: one meant
+  // for its backend, or else the oldest one of a backend with no idle thread.
+  // Chunks of a backend which can take them right away are not stolen, as a
+  // slower backend would take longer with them. Requires mutex_.
+  std::deque<Chunk>::iterator FindChunk(int child_idx) {
+    auto iter =
+        std::find_if(queue_.begin(), queue_.end(),
+                     [&](const Chunk& c) { return c.child == child_idx; });
+    if (iter != queue_.end()) return iter;
+    return std::find_if(queue_.begin(), queue_.end(), [&](const Chunk& c) {
+      return children_[c.child]->idle_threads == 0;
+    });
+  }
+
+  // Logs which part of the samples every backend computed, at most once per
+  // kReportInterval. Requires mutex_.
+  void ReportShares() {
+    constexpr auto kReportInterval = std::chrono::seconds(60);
+    const auto now = Clock::now();
+    if (children_.size() < 2 || now - last_report_ < kReportInterval) return;
+    last_report_ = now;
+    int64_t total = 0;
+    for (const auto& child : children_) total += child->samples;
+    if (total == 0) return;
+    std::string shares;
+    for (auto& child : children_) {
+      if (!shares.empty()) shares += ", ";
+      shares += child->name + " " +
+                std::to_string(100 * child->samples / total) + "%";
+      child->samples = 0;
+    }
+    LOGFILE << "Demux shares: " << shares << ".";
+  }
+
+  std::vector<std::unique_ptr<Child>> children_;
   NetworkCapabilities capabilities_;
-  std::queue<DemuxingComputation*> queue_;
+  std::deque<Chunk> queue_;
   int minimum_split_size_ = 0;
-  std::atomic<long long> counter_;
+  Clock::time_point last_report_ = Clock::now();
   bool abort_ = false;
 
   std::mutex mutex_;
@@ -225,17 +366,22 @@ class DemuxingNetwork : public Network {
 
 void DemuxingComputation::ComputeBlocking() {
   if (GetBatchSize() == 0) return;
-  partial_size_ = (GetBatchSize() + network_->threads_.size() - 1) /
-                  network_->threads_.size();
-  if (partial_size_ < network_->minimum_split_size_) {
-    partial_size_ = std::min(GetBatchSize(), network_->minimum_split_size_);
+  const auto chunks = network_->Split(GetBatchSize());
+
+  parents_.clear();
+  parents_.resize(chunks.size());
+  parent_start_.clear();
+  sample_parent_.clear();
+  for (size_t i = 0; i < chunks.size(); i++) {
+    parent_start_.push_back(sample_parent_.size());
+    sample_parent_.insert(sample_parent_.end(), chunks[i].first, i);
   }
-  const int splits = (GetBatchSize() + partial_size_ - 1) / partial_size_;
 
   std::unique_lock<std::mutex> lock(mutex_);
-  dataready_ = splits;
-  for (int j = 0; j < splits; j++) {
-    network_->Enqueue(this);
+  dataready_ = chunks.size();
+  for (size_t i = 0; i < chunks.size(); i++) {
+    network_->Enqueue(
+        {this, static_cast<int>(i), chunks[i].first, chunks[i].second});
   }
   dataready_cv_.wait(lock, [this]() { return dataready_ == 0; });
 }
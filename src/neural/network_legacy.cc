@@ -19,43 +19,111 @@
 #include "neural/network_legacy.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
+#include <optional>
+#include <thread>
 
 #include "utils/weights_adapter.h"
 
 namespace lczero {
 namespace {
 static constexpr float kEpsilon = 1e-5f;
+
+// Runs the jobs using all cores, as dequantizing large nets one layer at a
+// time dominates the startup time.
+void RunParallel(const std::vector<std::function<void()>>& jobs) {
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < jobs.size(); i = next++) jobs[i]();
+  };
+  const size_t thread_count = std::min<size_t>(
+      jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads) thread.join();
+}
+
+// Adds a job per block to decode them into @decoded.
+template <typename T, typename Proto, typename... Args>
+void AddDecodeJobs(const std::vector<Proto>& blocks,
+                   std::vector<std::optional<T>>* decoded,
+                   std::vector<std::function<void()>>* jobs,
+                   const Args&... args) {
+  decoded->resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); i++) {
+    jobs->emplace_back([&blocks, decoded, i, args...]() {
+      (*decoded)[i].emplace(blocks[i], args...);
+    });
+  }
+}
+
+template <typename T>
+std::vector<T> Unwrap(std::vector<std::optional<T>>* decoded) {
+  std::vector<T> result;
+  result.reserve(decoded->size());
+  for (auto& block : *decoded) result.emplace_back(std::move(*block));
+  return result;
+}
+
+// Decodes a layer unless @skip, then it's left empty.
+LegacyWeights::Vec DecodeUnless(bool skip,
+                                const pblczero::Weights::Layer& layer) {
+  return skip ? LegacyWeights::Vec() : LayerAdapter(layer).as_vector();
+}
 }  // namespace
 
-LegacyWeights::LegacyWeights(const pblczero::Weights& weights)
-    : input(weights.input()),
-      policy1(weights.policy1()),
-      policy(weights.policy()),
-      ip_pol_w(LayerAdapter(weights.ip_pol_w()).as_vector()),
-      ip_pol_b(LayerAdapter(weights.ip_pol_b()).as_vector()),
-      ip2_pol_w(LayerAdapter(weights.ip2_pol_w()).as_vector()),
+LegacyWeights::LegacyWeights(const pblczero::Weights& weights,
+                             bool skip_main_weights,
+                             bool skip_policy_conv_weights)
+    : ip_pol_b(LayerAdapter(weights.ip_pol_b()).as_vector()),
       ip2_pol_b(LayerAdapter(weights.ip2_pol_b()).as_vector()),
-      ip3_pol_w(LayerAdapter(weights.ip3_pol_w()).as_vector()),
       ip3_pol_b(LayerAdapter(weights.ip3_pol_b()).as_vector()),
-      ip4_pol_w(LayerAdapter(weights.ip4_pol_w()).as_vector()),
       value(weights.value()),
-      ip1_val_w(LayerAdapter(weights.ip1_val_w()).as_vector()),
       ip1_val_b(LayerAdapter(weights.ip1_val_b()).as_vector()),
-      ip2_val_w(LayerAdapter(weights.ip2_val_w()).as_vector()),
       ip2_val_b(LayerAdapter(weights.ip2_val_b()).as_vector()),
       moves_left(weights.moves_left()),
-      ip1_mov_w(LayerAdapter(weights.ip1_mov_w()).as_vector()),
       ip1_mov_b(LayerAdapter(weights.ip1_mov_b()).as_vector()),
-      ip2_mov_w(LayerAdapter(weights.ip2_mov_w()).as_vector()),
       ip2_mov_b(LayerAdapter(weights.ip2_mov_b()).as_vector()) {
-  for (const auto& res : weights.residual()) {
-    residual.emplace_back(res);
-  }
   pol_encoder_head_count = weights.pol_headcount();
-  for (const auto& enc : weights.pol_encoder()) {
-    pol_encoder.emplace_back(enc);
-  }
+
+  // All the large tensors are decoded in parallel: the convolutions, the
+  // fully connected weights of the heads, the residual blocks and the policy
+  // encoder layers.
+  std::vector<std::function<void()>> jobs;
+  jobs.emplace_back(
+      [&]() { input = ConvBlock(weights.input(), skip_main_weights); });
+  jobs.emplace_back([&]() {
+    policy1 = ConvBlock(weights.policy1(), skip_policy_conv_weights);
+  });
+  jobs.emplace_back([&]() {
+    policy = ConvBlock(weights.policy(), skip_policy_conv_weights);
+  });
+  const auto add_layer = [&jobs](Vec* output,
+                                 const pblczero::Weights::Layer& layer,
+                                 bool skip) {
+    jobs.emplace_back(
+        [output, &layer, skip]() { *output = DecodeUnless(skip, layer); });
+  };
+  add_layer(&ip_pol_w, weights.ip_pol_w(), skip_main_weights);
+  add_layer(&ip2_pol_w, weights.ip2_pol_w(), false);
+  add_layer(&ip3_pol_w, weights.ip3_pol_w(), false);
+  add_layer(&ip4_pol_w, weights.ip4_pol_w(), false);
+  add_layer(&ip1_val_w, weights.ip1_val_w(), skip_main_weights);
+  add_layer(&ip2_val_w, weights.ip2_val_w(), false);
+  add_layer(&ip1_mov_w, weights.ip1_mov_w(), skip_main_weights);
+  add_layer(&ip2_mov_w, weights.ip2_mov_w(), false);
+  std::vector<std::optional<Residual>> decoded_residual;
+  AddDecodeJobs(weights.residual(), &decoded_residual, &jobs,
+                skip_main_weights);
+  std::vector<std::optional<EncoderLayer>> decoded_encoder;
+  AddDecodeJobs(weights.pol_encoder(), &decoded_encoder, &jobs);
+  RunParallel(jobs);
+
+  residual = Unwrap(&decoded_residual);
+  pol_encoder = Unwrap(&decoded_encoder);
 }
 
 LegacyWeights::SEunit::SEunit(const pblczero::Weights::SEunit& se)
@@ -64,20 +132,22 @@ LegacyWeights::SEunit::SEunit(const pblczero::Weights::SEunit& se)
       w2(LayerAdapter(se.w2()).as_vector()),
       b2(LayerAdapter(se.b2()).as_vector()) {}
 
-LegacyWeights::Residual::Residual(const pblczero::Weights::Residual& residual)
-    : conv1(residual.conv1()),
-      conv2(residual.conv2()),
+LegacyWeights::Residual::Residual(const pblczero::Weights::Residual& residual,
+                                  bool skip_conv_weights)
+    : conv1(residual.conv1(), skip_conv_weights),
+      conv2(residual.conv2(), skip_conv_weights),
       se(residual.se()),
       has_se(residual.has_se()) {}
 
-LegacyWeights::ConvBlock::ConvBlock(const pblczero::Weights::ConvBlock& block)
-    : weights(LayerAdapter(block.weights()).as_vector()),
+LegacyWeights::ConvBlock::ConvBlock(const pblczero::Weights::ConvBlock& block,
+                                    bool skip_weights)
+    : weights(DecodeUnless(skip_weights, block.weights())),
       biases(LayerAdapter(block.biases()).as_vector()),
       bn_gammas(LayerAdapter(block.bn_gammas()).as_vector()),
       bn_betas(LayerAdapter(block.bn_betas()).as_vector()),
       bn_means(LayerAdapter(block.bn_means()).as_vector()),
       bn_stddivs(LayerAdapter(block.bn_stddivs()).as_vector()) {
-  if (weights.size() == 0) {
+  if (block.weights().params().empty()) {
     // Empty ConvBlock.
     return;
   }
@@ -110,6 +180,7 @@ LegacyWeights::ConvBlock::ConvBlock(const pblczero::Weights::ConvBlock& block)
   auto outputs = biases.size();
 
   // We can treat the [inputs, filter_size, filter_size] dimensions as one.
+  // Zero if the weights are skipped.
   auto inputs = weights.size() / outputs;
 
   for (auto o = size_t{0}; o < outputs; o++) {
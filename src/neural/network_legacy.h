@@ -25,11 +25,22 @@
 namespace lczero {
 
 struct LegacyWeights {
-  explicit LegacyWeights(const pblczero::Weights& weights);
+  explicit LegacyWeights(const pblczero::Weights& weights)
+      : LegacyWeights(weights, false, false) {}
+  // For backends which load the large tensors already prepared: with
+  // @skip_main_weights the weights of the input and residual convolutions and
+  // of the first fully connected layer of each head are left empty, with
+  // @skip_policy_conv_weights those of the policy convolutions. Their biases
+  // are still decoded.
+  LegacyWeights(const pblczero::Weights& weights, bool skip_main_weights,
+                bool skip_policy_conv_weights);
 
   using Vec = std::vector<float>;
   struct ConvBlock {
-    explicit ConvBlock(const pblczero::Weights::ConvBlock& block);
+    ConvBlock() = default;
+    // With @skip_weights, only the biases are decoded.
+    explicit ConvBlock(const pblczero::Weights::ConvBlock& block,
+                       bool skip_weights = false);
 
     Vec weights;
     Vec biases;
@@ -48,7 +59,8 @@ struct LegacyWeights {
   };
 
   struct Residual {
-    explicit Residual(const pblczero::Weights::Residual& residual);
+    explicit Residual(const pblczero::Weights::Residual& residual,
+                      bool skip_conv_weights = false);
     ConvBlock conv1;
     ConvBlock conv2;
     SEunit se;
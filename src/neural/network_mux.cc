@@ -25,51 +25,185 @@
   Program grant you additional permission to convey the resulting work.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
-#include <queue>
+#include <cstring>
+#include <deque>
+#include <optional>
 #include <thread>
+#include <unordered_map>
 
 #include "neural/factory.h"
 #include "utils/exception.h"
+#include "utils/hashcat.h"
 #include "utils/numa.h"
 
 namespace lczero {
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
+// Online least squares fit of the computation time of a backend as
+// fixed + per_sample * batch_size. Old measurements decay, so that the fit
+// follows changes of the machine load.
+class LatencyModel {
+ public:
+  void Add(int batch_size, double seconds) {
+    constexpr double kDecay = 0.99;
+    n_ = n_ * kDecay + 1.0;
+    b_ = b_ * kDecay + batch_size;
+    bb_ = bb_ * kDecay + static_cast<double>(batch_size) * batch_size;
+    t_ = t_ * kDecay + seconds;
+    bt_ = bt_ * kDecay + batch_size * seconds;
+  }
+
+  // Predicted computation time of a batch, in seconds.
+  double Predict(int batch_size) const {
+    double fixed, per_sample;
+    if (Fit(&fixed, &per_sample)) return fixed + per_sample * batch_size;
+    return n_ > 0.0 ? t_ / n_ : 0.0;
+  }
+
+  // The batch size at which the fixed cost is a tenth of the computation
+  // time, past which waiting for a larger batch gains little. Until batches
+  // of different sizes were measured, returns @max_batch.
+  int TargetBatch(int max_batch) const {
+    double fixed, per_sample;
+    if (!Fit(&fixed, &per_sample) || per_sample <= 0.0) return max_batch;
+    const double target = std::ceil(9.0 * std::max(fixed, 0.0) / per_sample);
+    return static_cast<int>(std::clamp(target, 1.0, double(max_batch)));
+  }
+
+ private:
+  bool Fit(double* fixed, double* per_sample) const {
+    const double det = n_ * bb_ - b_ * b_;
+    // Needs a spread of batch sizes, a variance of at least a quarter.
+    if (n_ <= 0.0 || det < 0.25 * n_ * n_) return false;
+    *per_sample = (n_ * bt_ - b_ * t_) / det;
+    *fixed = (t_ - *per_sample * b_) / n_;
+    return true;
+  }
+
+  double n_ = 0.0;
+  double b_ = 0.0;
+  double bb_ = 0.0;
+  double t_ = 0.0;
+  double bt_ = 0.0;
+};
+
+uint64_t HashInput(const InputPlanes& planes) {
+  uint64_t hash = planes.size();
+  for (const auto& plane : planes) {
+    uint32_t value;
+    std::memcpy(&value, &plane.value, sizeof(value));
+    hash = HashCat(HashCat(hash, plane.mask), value);
+  }
+  return hash;
+}
+
+// Whether the planes are identical, comparing the values bitwise like
+// HashInput().
+bool SameInput(const InputPlanes& a, const InputPlanes& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].mask != b[i].mask ||
+        std::memcmp(&a[i].value, &b[i].value, sizeof(float)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A sample added to the parent computation, by the hash of its input and
+// requested policy outputs. It points to the child computation's copy, which
+// stays alive until the parent is computed.
+struct SampleInParent {
+  const InputPlanes* planes;
+  const std::vector<uint16_t>* policy_indices;
+  int idx;
+};
+using SamplesInParent = std::unordered_multimap<uint64_t, SampleInParent>;
+
 class MuxingNetwork;
 class MuxingComputation : public NetworkComputation {
  public:
   MuxingComputation(MuxingNetwork* network) : network_(network) {}
 
-  void AddInput(InputPlanes&& input) override { planes_.emplace_back(input); }
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithPolicyIndices(std::move(input), {});
+  }
+
+  void AddInputWithPolicyIndices(
+      InputPlanes&& input, std::vector<uint16_t> policy_indices) override {
+    planes_.emplace_back(std::move(input));
+    policy_indices_.emplace_back(std::move(policy_indices));
+  }
 
   void ComputeBlocking() override;
 
+  void SetDeadline(Clock::time_point deadline) override {
+    deadline_ = deadline;
+  }
+
   int GetBatchSize() const override { return planes_.size(); }
 
   float GetQVal(int sample) const override {
-    return parent_->GetQVal(sample + idx_in_parent_);
+    return parent_->GetQVal(idx_in_parent_[sample]);
   }
 
   float GetDVal(int sample) const override {
-    return parent_->GetDVal(sample + idx_in_parent_);
+    return parent_->GetDVal(idx_in_parent_[sample]);
   }
 
   float GetMVal(int sample) const override {
-    return parent_->GetMVal(sample + idx_in_parent_);
+    return parent_->GetMVal(idx_in_parent_[sample]);
   }
 
   float GetPVal(int sample, int move_id) const override {
-    return parent_->GetPVal(sample + idx_in_parent_, move_id);
+    return parent_->GetPVal(idx_in_parent_[sample], move_id);
   }
 
-  void PopulateToParent(std::shared_ptr<NetworkComputation> parent) {
-    // Populate our batch into batch of batches.
+  // Populates our batch into batch of batches. Inputs identical to ones
+  // already there, found through @in_parent, are computed only once. Our
+  // inputs are copied, so that later ones can be compared to them.
+  void PopulateToParent(std::shared_ptr<NetworkComputation> parent,
+                        SamplesInParent* in_parent) {
     parent_ = parent;
-    idx_in_parent_ = parent->GetBatchSize();
-    for (auto& x : planes_) parent_->AddInput(std::move(x));
+    idx_in_parent_.clear();
+    for (size_t i = 0; i < planes_.size(); i++) {
+      // The requested policy outputs are part of the key, so that a sample is
+      // never shared with one having fewer of them computed.
+      uint64_t hash = HashInput(planes_[i]);
+      for (auto idx : policy_indices_[i]) hash = HashCat(hash, idx);
+      int idx = -1;
+      const auto range = in_parent->equal_range(hash);
+      for (auto iter = range.first; iter != range.second; ++iter) {
+        const auto& sample = iter->second;
+        if (*sample.policy_indices == policy_indices_[i] &&
+            SameInput(*sample.planes, planes_[i])) {
+          idx = sample.idx;
+          break;
+        }
+      }
+      if (idx < 0) {
+        idx = parent_->GetBatchSize();
+        in_parent->emplace(hash, SampleInParent{&planes_[i],
+                                                &policy_indices_[i], idx});
+        parent_->AddInputWithPolicyIndices(InputPlanes(planes_[i]),
+                                           policy_indices_[i]);
+      }
+      idx_in_parent_.push_back(idx);
+    }
   }
 
+  const std::optional<Clock::time_point>& deadline() const {
+    return deadline_;
+  }
+  Clock::time_point enqueued() const { return enqueued_; }
+  void set_enqueued(Clock::time_point time) { enqueued_ = time; }
+
   void NotifyReady() {
     std::unique_lock<std::mutex> lock(mutex_);
     dataready_ = true;
@@ -78,9 +212,12 @@ class MuxingComputation : public NetworkComputation {
 
  private:
   std::vector<InputPlanes> planes_;
+  std::vector<std::vector<uint16_t>> policy_indices_;
   MuxingNetwork* network_;
   std::shared_ptr<NetworkComputation> parent_;
-  int idx_in_parent_ = 0;
+  std::vector<int> idx_in_parent_;
+  std::optional<Clock::time_point> deadline_;
+  Clock::time_point enqueued_;
 
   std::mutex mutex_;
   std::condition_variable dataready_cv_;
@@ -88,6 +225,15 @@ class MuxingComputation : public NetworkComputation {
 };
 
 class MuxingNetwork : public Network {
+  struct Backend {
+    std::unique_ptr<Network> network;
+    int max_batch;
+    int target_batch;
+    Clock::duration max_wait;
+    // Guarded by mutex_.
+    LatencyModel latency;
+  };
+
  public:
   MuxingNetwork(const std::optional<WeightsFile>& weights,
                 const OptionsDict& options) {
@@ -111,22 +257,32 @@ class MuxingNetwork : public Network {
                   const std::optional<WeightsFile>& weights,
                   const OptionsDict& opts) {
     const int nn_threads = opts.GetOrDefault<int>("threads", 1);
-    const int max_batch = opts.GetOrDefault<int>("max_batch", 256);
     const std::string backend = opts.GetOrDefault<std::string>("backend", name);
 
-    networks_.emplace_back(
-        NetworkFactory::Get()->Create(backend, weights, opts));
-    Network* net = networks_.back().get();
-
-    if (networks_.size() == 1) {
+    auto entry = std::make_unique<Backend>();
+    entry->network = NetworkFactory::Get()->Create(backend, weights, opts);
+    entry->max_batch = opts.GetOrDefault<int>("max_batch", 256);
+    // Holding computations back for up to max_wait_ms lets the batch grow to
+    // target_batch, or to the size derived from the measured latency if 0.
+    entry->target_batch = opts.GetOrDefault<int>("target_batch", 0);
+    const float max_wait_ms =
+        opts.Exists<float>("max_wait_ms")
+            ? opts.Get<float>("max_wait_ms")
+            : opts.GetOrDefault<int>("max_wait_ms", 0);
+    entry->max_wait = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(max_wait_ms));
+    backends_.push_back(std::move(entry));
+    Backend* entry_ptr = backends_.back().get();
+    Network* net = entry_ptr->network.get();
+
+    if (backends_.size() == 1) {
       capabilities_ = net->GetCapabilities();
     } else {
       capabilities_.Merge(net->GetCapabilities());
     }
 
     for (int i = 0; i < nn_threads; ++i) {
-      threads_.emplace_back(
-          [this, net, max_batch, i]() { Worker(net, max_batch, i); });
+      threads_.emplace_back([this, entry_ptr, i]() { Worker(entry_ptr, i); });
     }
   }
 
@@ -140,8 +296,15 @@ class MuxingNetwork : public Network {
 
   void Enqueue(MuxingComputation* computation) {
     std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(computation);
-    cv_.notify_one();
+    computation->set_enqueued(Clock::now());
+    queue_.push_back(computation);
+    queued_samples_ += computation->GetBatchSize();
+    // Workers holding a batch back recheck it on every arrival.
+    if (filling_ > 0) {
+      cv_.notify_all();
+    } else {
+      cv_.notify_one();
+    }
   }
 
   ~MuxingNetwork() {
@@ -150,16 +313,19 @@ class MuxingNetwork : public Network {
     // Unstuck waiting computations.
     while (!queue_.empty()) {
       queue_.front()->NotifyReady();
-      queue_.pop();
+      queue_.pop_front();
     }
   }
 
-  void Worker(Network* network, const int max_batch, int id) {
+  void Worker(Backend* backend, int id) {
+    Network* network = backend->network.get();
+    const int max_batch = backend->max_batch;
     // Add one to the id in order to leave space for an active search thread.
     Numa::BindThread(id + 1);
     // While Abort() is not called (and it can only be called from destructor).
     while (!abort_) {
       std::vector<MuxingComputation*> children;
+      SamplesInParent in_parent;
       // Create new computation in "upstream" network, to gather batch into
       // there.
       std::shared_ptr<NetworkComputation> parent(network->NewComputation());
@@ -169,6 +335,22 @@ class MuxingNetwork : public Network {
         cv_.wait(lock, [&] { return abort_ || !queue_.empty(); });
         if (abort_) break;
 
+        // Hold the batch back until it reaches the target size, or until one
+        // of the queued computations can't wait any longer.
+        const int target = std::min(
+            max_batch, backend->target_batch > 0
+                           ? backend->target_batch
+                           : backend->latency.TargetBatch(max_batch));
+        ++filling_;
+        while (!abort_ && !queue_.empty() && queued_samples_ < target) {
+          if (cv_.wait_until(lock, StartDeadline(*backend)) ==
+              std::cv_status::timeout) {
+            break;
+          }
+        }
+        --filling_;
+        if (abort_) break;
+
         // While there is a work in queue, add it.
         while (!queue_.empty()) {
           // If we are reaching batch size limit, stop adding.
@@ -181,17 +363,44 @@ class MuxingNetwork : public Network {
           }
           // Remember which of "input" computations we serve.
           children.push_back(queue_.front());
-          queue_.pop();
+          queue_.pop_front();
+          queued_samples_ -= children.back()->GetBatchSize();
           // Make "input" computation populate data into output batch.
-          children.back()->PopulateToParent(parent);
+          children.back()->PopulateToParent(parent, &in_parent);
         }
       }
 
+      // Another worker took the queue while this one was waiting.
+      if (children.empty()) continue;
+
       // Compute.
+      const auto start = Clock::now();
       parent->ComputeBlocking();
+      const std::chrono::duration<double> elapsed = Clock::now() - start;
       // Notify children that data is ready!
       for (auto child : children) child->NotifyReady();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      backend->latency.Add(parent->GetBatchSize(), elapsed.count());
+    }
+  }
+
+  // The latest time to start computing the queued computations: when the
+  // oldest of them waited for max_wait, or earlier, the predicted computation
+  // time before the earliest deadline. Requires mutex_.
+  Clock::time_point StartDeadline(const Backend& backend) const {
+    const auto compute = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(
+            backend.latency.Predict(std::min(queued_samples_,
+                                             backend.max_batch))));
+    auto result = Clock::time_point::max();
+    for (const auto* computation : queue_) {
+      result = std::min(result, computation->enqueued() + backend.max_wait);
+      if (computation->deadline()) {
+        result = std::min(result, *computation->deadline() - compute);
+      }
     }
+    return result;
   }
 
   void Abort() {
@@ -210,8 +419,12 @@ class MuxingNetwork : public Network {
   }
 
  private:
-  std::vector<std::unique_ptr<Network>> networks_;
-  std::queue<MuxingComputation*> queue_;
+  std::vector<std::unique_ptr<Backend>> backends_;
+  std::deque<MuxingComputation*> queue_;
+  // Total batch size of the computations in the queue.
+  int queued_samples_ = 0;
+  // Number of workers holding a batch back.
+  int filling_ = 0;
   bool abort_ = false;
   NetworkCapabilities capabilities_;
 
@@ -25,20 +25,82 @@
   Program grant you additional permission to convey the resulting work.
 */
 
-#include <condition_variable>
-#include <queue>
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <optional>
 
 #include "neural/factory.h"
 #include "utils/exception.h"
+#include "utils/logging.h"
 
 namespace lczero {
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
+class RoundRobinNetwork;
+
+// Collects the inputs, and only when computed picks the backend, with the
+// batch size and the current load known.
+class DispatchingComputation : public NetworkComputation {
+ public:
+  DispatchingComputation(RoundRobinNetwork* network) : network_(network) {}
+
+  void AddInput(InputPlanes&& input) override {
+    AddInputWithPolicyIndices(std::move(input), {});
+  }
+  void AddInputWithPolicyIndices(
+      InputPlanes&& input, std::vector<uint16_t> policy_indices) override {
+    planes_.emplace_back(std::move(input));
+    policy_indices_.emplace_back(std::move(policy_indices));
+  }
+  void ComputeBlocking() override;
+  int GetBatchSize() const override {
+    return computation_ ? computation_->GetBatchSize() : planes_.size();
+  }
+  float GetQVal(int sample) const override {
+    return computation_->GetQVal(sample);
+  }
+  float GetDVal(int sample) const override {
+    return computation_->GetDVal(sample);
+  }
+  float GetPVal(int sample, int move_id) const override {
+    return computation_->GetPVal(sample, move_id);
+  }
+  float GetMVal(int sample) const override {
+    return computation_->GetMVal(sample);
+  }
+
+ private:
+  RoundRobinNetwork* network_;
+  std::vector<InputPlanes> planes_;
+  std::vector<std::vector<uint16_t>> policy_indices_;
+  std::unique_ptr<NetworkComputation> computation_;
+};
+
 class RoundRobinNetwork : public Network {
  public:
+  enum class Dispatch { kRoundRobin, kLeastLoaded, kFastest };
+
   RoundRobinNetwork(const std::optional<WeightsFile>& weights,
                     const OptionsDict& options) {
+    const auto dispatch =
+        options.GetOrDefault<std::string>("dispatch", "roundrobin");
+    if (dispatch == "roundrobin") {
+      dispatch_ = Dispatch::kRoundRobin;
+    } else if (dispatch == "least-loaded") {
+      dispatch_ = Dispatch::kLeastLoaded;
+    } else if (dispatch == "fastest") {
+      dispatch_ = Dispatch::kFastest;
+    } else {
+      throw Exception("Unknown dispatch mode " + dispatch +
+                      ", should be one of roundrobin, least-loaded, fastest.");
+    }
+
     const auto parents = options.ListSubdicts();
     if (parents.empty()) {
       // If options are empty, or multiplexer configured in root object,
@@ -57,33 +119,146 @@ class RoundRobinNetwork : public Network {
                   const OptionsDict& opts) {
     const std::string backend = opts.GetOrDefault<std::string>("backend", name);
 
-    networks_.emplace_back(
-        NetworkFactory::Get()->Create(backend, weights, opts));
+    children_.emplace_back();
+    children_.back().name = name;
+    children_.back().network =
+        NetworkFactory::Get()->Create(backend, weights, opts);
 
-    if (networks_.size() == 1) {
-      capabilities_ = networks_.back()->GetCapabilities();
+    if (children_.size() == 1) {
+      capabilities_ = children_.back().network->GetCapabilities();
     } else {
-      capabilities_.Merge(networks_.back()->GetCapabilities());
+      capabilities_.Merge(children_.back().network->GetCapabilities());
     }
   }
 
   std::unique_ptr<NetworkComputation> NewComputation() override {
+    if (dispatch_ != Dispatch::kRoundRobin) {
+      return std::make_unique<DispatchingComputation>(this);
+    }
     const long long val = ++counter_;
-    return networks_[val % networks_.size()]->NewComputation();
+    return children_[val % children_.size()].network->NewComputation();
   }
 
   const NetworkCapabilities& GetCapabilities() const override {
     return capabilities_;
   }
 
+  // Samples currently being computed, or waiting to be, on backend @idx.
+  int GetOutstanding(size_t idx) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return children_[idx].outstanding;
+  }
+
+  // Picks the backend for a batch of @batch_size samples and counts them as
+  // outstanding there.
+  size_t Acquire(int batch_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Backends with no measurements yet are dispatched by load only.
+    bool measured = dispatch_ == Dispatch::kFastest;
+    for (const auto& child : children_) {
+      measured = measured && child.throughput > 0.0;
+    }
+    // Start from a rotating index so that ties go round robin.
+    const size_t first = ++counter_ % children_.size();
+    size_t best = first;
+    double best_cost = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < children_.size(); i++) {
+      const size_t idx = (first + i) % children_.size();
+      const auto& child = children_[idx];
+      const double cost =
+          measured ? (child.outstanding + batch_size) / child.throughput
+                   : child.outstanding;
+      if (cost < best_cost) {
+        best = idx;
+        best_cost = cost;
+      }
+    }
+    children_[best].outstanding += batch_size;
+    return best;
+  }
+
+  // Releases a batch acquired with Acquire(). If it was computed, it took
+  // @seconds.
+  void Release(size_t idx, int batch_size, std::optional<double> seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& child = children_[idx];
+    child.outstanding -= batch_size;
+    ReportLoad();
+    if (!seconds) return;
+    // Exponential average of the samples per second.
+    constexpr double kAlpha = 0.1;
+    const double throughput = batch_size / std::max(*seconds, 1e-6);
+    child.throughput =
+        child.throughput > 0.0
+            ? (1.0 - kAlpha) * child.throughput + kAlpha * throughput
+            : throughput;
+  }
+
+  Network* child(size_t idx) const { return children_[idx].network.get(); }
+
   ~RoundRobinNetwork() {}
 
  private:
-  std::vector<std::unique_ptr<Network>> networks_;
+  // Logs the outstanding samples and throughput of every backend, at most
+  // once a minute. Must hold mutex_.
+  void ReportLoad() {
+    constexpr auto kReportInterval = std::chrono::seconds(60);
+    const auto now = Clock::now();
+    if (children_.size() < 2 || now - last_report_ < kReportInterval) return;
+    last_report_ = now;
+    std::string load;
+    for (const auto& child : children_) {
+      if (!load.empty()) load += ", ";
+      load += child.name + " " + std::to_string(child.outstanding) +
+              " outstanding " + std::to_string(std::lround(child.throughput)) +
+              "/s";
+    }
+    LOGFILE << "Roundrobin load: " << load << ".";
+  }
+
+  struct Child {
+    std::string name;
+    std::unique_ptr<Network> network;
+    // Guarded by mutex_.
+    int outstanding = 0;
+    double throughput = 0.0;
+  };
+
+  std::vector<Child> children_;
   std::atomic<long long> counter_;
   NetworkCapabilities capabilities_;
+  Dispatch dispatch_;
+  // Guarded by mutex_.
+  Clock::time_point last_report_ = Clock::now();
+  mutable std::mutex mutex_;
 };
 
+void DispatchingComputation::ComputeBlocking() {
+  const int batch_size = GetBatchSize();
+  const size_t idx = network_->Acquire(batch_size);
+  // Released also if the computation throws, or the backend would look busy
+  // for good.
+  struct Releaser {
+    ~Releaser() { network->Release(idx, batch_size, seconds); }
+    RoundRobinNetwork* network;
+    size_t idx;
+    int batch_size;
+    // Set once computed.
+    std::optional<double> seconds;
+  } releaser{network_, idx, batch_size, std::nullopt};
+  computation_ = network_->child(idx)->NewComputation();
+  for (size_t i = 0; i < planes_.size(); i++) {
+    computation_->AddInputWithPolicyIndices(std::move(planes_[i]),
+                                            std::move(policy_indices_[i]));
+  }
+  planes_.clear();
+  policy_indices_.clear();
+  const auto start = Clock::now();
+  computation_->ComputeBlocking();
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  releaser.seconds = elapsed.count();
+}
+
 std::unique_ptr<Network> MakeRoundRobinNetwork(
     const std::optional<WeightsFile>& weights, const OptionsDict& options) {
   return std::make_unique<RoundRobinNetwork>(weights, options);
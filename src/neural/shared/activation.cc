@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 
 #ifdef USE_ISPC
 #include "activation_ispc.h"
@@ -218,4 +219,19 @@ void BiasActivate(const size_t batch_size, const size_t channels, float* data,
   }
 }
 
+const char* IspcTargetName() {
+#ifdef USE_ISPC
+  // Indexed by the value of IspcTarget() in activation.ispc.
+  static const char* const kNames[] = {"unknown",   "sse2",      "sse4",
+                                       "avx1",      "avx2",      "avx512knl",
+                                       "avx512skx", "neon"};
+  const int target = ispc::IspcTarget();
+  return target >= 0 && target < static_cast<int>(std::size(kNames))
+             ? kNames[target]
+             : kNames[0];
+#else
+  return nullptr;
+#endif
+}
+
 }  // namespace lczero
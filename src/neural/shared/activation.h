@@ -44,4 +44,8 @@ void Activate(const size_t len, float gamma, const float* data,
               const float* bias, float beta, float* out,
               const ActivationFunction activation);
 
+// The target the ISPC kernels were dispatched to on this processor, nullptr if
+// built without ISPC.
+const char* IspcTargetName();
+
 }  // namespace lczero
@@ -21,7 +21,7 @@
 namespace lczero {
 
 // 73x8x8.
-const short kConvPolicyMap[] = {
+constexpr short kConvPolicyMap[] = {
     7,    31,   56,   81,   106,  131,  156,  180,  204,  230,  259,  288,
     317,  346,  374,  400,  425,  453,  485,  518,  551,  584,  615,  642,
     667,  695,  727,  761,  796,  830,  861,  888,  913,  941,  973,  1007,
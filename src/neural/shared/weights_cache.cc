@@ -0,0 +1,195 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2024 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "neural/shared/weights_cache.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "utils/files.h"
+#include "utils/hashcat.h"
+#include "utils/logging.h"
+#include "utils/random.h"
+
+namespace lczero {
+
+namespace {
+constexpr uint64_t kCacheMagic = 0x6568636163307a6cULL;  // "lz0cache"
+constexpr uint64_t kCacheVersion = 1;
+
+struct CacheHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t key;
+  uint64_t size;
+  uint64_t checksum;
+};
+}  // namespace
+
+uint64_t HashBytes(std::string_view data) {
+  uint64_t hash = data.size();
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data.data() + i, sizeof(word));
+    hash = HashCat(hash, word);
+  }
+  for (; i < data.size(); i++) hash = HashCat(hash, data[i]);
+  return hash;
+}
+
+namespace {
+using Weights = pblczero::Weights;
+
+uint64_t HashLayer(uint64_t hash, const Weights::Layer& layer) {
+  const float range[] = {layer.min_val(), layer.max_val()};
+  hash = HashCat(hash, HashBytes({reinterpret_cast<const char*>(range),
+                                  sizeof(range)}));
+  return HashCat(hash, HashBytes(layer.params()));
+}
+
+uint64_t HashConvBlock(uint64_t hash, const Weights::ConvBlock& block) {
+  for (const auto* layer :
+       {&block.weights(), &block.biases(), &block.bn_means(),
+        &block.bn_stddivs(), &block.bn_gammas(), &block.bn_betas()}) {
+    hash = HashLayer(hash, *layer);
+  }
+  return hash;
+}
+
+uint64_t HashEncoderLayer(uint64_t hash, const Weights::EncoderLayer& layer) {
+  const auto& mha = layer.mha();
+  const auto& ffn = layer.ffn();
+  for (const auto* params :
+       {&mha.q_w(), &mha.q_b(), &mha.k_w(), &mha.k_b(), &mha.v_w(),
+        &mha.v_b(), &mha.dense_w(), &mha.dense_b(), &layer.ln1_gammas(),
+        &layer.ln1_betas(), &ffn.dense1_w(), &ffn.dense1_b(), &ffn.dense2_w(),
+        &ffn.dense2_b(), &layer.ln2_gammas(), &layer.ln2_betas()}) {
+    hash = HashLayer(hash, *params);
+  }
+  return hash;
+}
+}  // namespace
+
+uint64_t HashWeights(const pblczero::Weights& weights) {
+  uint64_t hash = HashConvBlock(0, weights.input());
+  for (const auto& residual : weights.residual()) {
+    hash = HashConvBlock(hash, residual.conv1());
+    hash = HashConvBlock(hash, residual.conv2());
+    const auto& se = residual.se();
+    hash = HashCat(hash, residual.has_se());
+    for (const auto* layer : {&se.w1(), &se.b1(), &se.w2(), &se.b2()}) {
+      hash = HashLayer(hash, *layer);
+    }
+  }
+  for (const auto* block : {&weights.policy1(), &weights.policy(),
+                            &weights.value(), &weights.moves_left()}) {
+    hash = HashConvBlock(hash, *block);
+  }
+  for (const auto& layer : weights.pol_encoder()) {
+    hash = HashEncoderLayer(hash, layer);
+  }
+  hash = HashCat(hash, weights.pol_headcount());
+  for (const auto* layer :
+       {&weights.ip_pol_w(), &weights.ip_pol_b(), &weights.ip2_pol_w(),
+        &weights.ip2_pol_b(), &weights.ip3_pol_w(), &weights.ip3_pol_b(),
+        &weights.ip4_pol_w(), &weights.ip1_val_w(), &weights.ip1_val_b(),
+        &weights.ip2_val_w(), &weights.ip2_val_b(), &weights.ip1_mov_w(),
+        &weights.ip1_mov_b(), &weights.ip2_mov_w(), &weights.ip2_mov_b()}) {
+    hash = HashLayer(hash, *layer);
+  }
+  return hash;
+}
+
+WeightsCache::WeightsCache(const std::string& directory, uint64_t key)
+    : key_(key) {
+  std::string path = directory;
+  if (path.empty()) {
+    path = GetUserCacheDirectory();
+    if (!path.empty()) {
+      path += "lc0/";
+      CreateDirectory(path);
+    }
+    path += "weights";
+  }
+  CreateDirectory(path);
+  char name[32];
+  snprintf(name, sizeof(name), "/%016" PRIx64 ".bin", key);
+  filename_ = path + name;
+}
+
+std::string_view WeightsCache::Load() {
+  if (GetFileSize(filename_) < sizeof(CacheHeader)) return {};
+  try {
+    mapped_ = std::make_unique<MappedFile>(filename_);
+  } catch (const Exception&) {
+    return {};
+  }
+  auto data = mapped_->data();
+  CacheHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  data.remove_prefix(sizeof(header));
+  if (header.magic != kCacheMagic || header.version != kCacheVersion ||
+      header.key != key_ || header.size != data.size() ||
+      header.checksum != HashBytes(data)) {
+    CERR << "Ignoring invalid weights cache entry " << filename_ << ".";
+    mapped_.reset();
+    return {};
+  }
+  return data;
+}
+
+void WeightsCache::Store(std::string_view payload) const {
+  const CacheHeader header{kCacheMagic, kCacheVersion, key_, payload.size(),
+                           HashBytes(payload)};
+  std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents.append(payload);
+  // Write to a temporary file first, so that a concurrently starting engine
+  // never maps a partially written entry. The name is unique to this process
+  // and call, so that engines storing the same entry at once don't write into
+  // the same file.
+#ifdef _WIN32
+  const int pid = _getpid();
+#else
+  const int pid = getpid();
+#endif
+  const std::string temp = filename_ + "." + std::to_string(pid) + "." +
+                           Random::Get().GetString(8) + ".tmp";
+  try {
+    WriteStringToFile(temp, contents);
+  } catch (const Exception& e) {
+    CERR << "Cannot write weights cache entry: " << e.what();
+    return;
+  }
+#ifdef _WIN32
+  // Unlike POSIX, Windows doesn't replace an existing file on rename.
+  std::remove(filename_.c_str());
+#endif
+  if (std::rename(temp.c_str(), filename_.c_str()) != 0) {
+    CERR << "Cannot write weights cache entry " << filename_ << ".";
+    std::remove(temp.c_str());
+  }
+}
+
+}  // namespace lczero
@@ -0,0 +1,138 @@
+/*
+ This file is part of Leela Chess Zero.
+ Copyright (C) 2024 The LCZero Authors
+
+ Leela Chess is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Leela Chess is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "proto/net.pb.h"
+#include "utils/exception.h"
+#include "utils/filesystem.h"
+#include "utils/mutex.h"
+
+namespace lczero {
+
+// Hashes raw data, for cache keys and checksums.
+uint64_t HashBytes(std::string_view data);
+// Hashes the layers of a network as they are encoded in the file, without
+// decoding or copying them.
+uint64_t HashWeights(const pblczero::Weights& weights);
+
+// Serializes plain values and arrays into a cache blob.
+class BlobWriter {
+ public:
+  template <typename T>
+  void Write(const T& value) {
+    Write(&value, 1);
+  }
+  template <typename T>
+  void Write(const T* values, size_t count) {
+    buffer_.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+  }
+  std::string_view data() const { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Reads back what BlobWriter wrote. Throws exception on truncated data.
+class BlobReader {
+ public:
+  explicit BlobReader(std::string_view data) : data_(data) {}
+
+  template <typename T>
+  T Read() {
+    T value;
+    Read(&value, 1);
+    return value;
+  }
+  template <typename T>
+  void Read(T* values, size_t count) {
+    if (count > data_.size() / sizeof(T)) {
+      throw Exception("Truncated weights cache entry.");
+    }
+    std::memcpy(values, data_.data(), count * sizeof(T));
+    data_.remove_prefix(count * sizeof(T));
+  }
+  template <typename T>
+  std::vector<T> ReadVector() {
+    std::vector<T> values(Read<uint64_t>());
+    Read(values.data(), values.size());
+    return values;
+  }
+  bool done() const { return data_.empty(); }
+
+ private:
+  std::string_view data_;
+};
+
+// An on-disk cache of backend-ready weights. Entries are named by @key, which
+// should hash everything the prepared weights depend on: the network, the
+// backend and its options, the CPU features used to select the layout.
+// Corrupt or truncated entries are treated as missing.
+class WeightsCache {
+ public:
+  // An empty @directory means the lc0 subdirectory of the user cache.
+  WeightsCache(const std::string& directory, uint64_t key);
+
+  // Returns the payload of the entry, or an empty view if there is no valid
+  // entry. The view stays valid as long as this object.
+  std::string_view Load();
+  // Writes the entry, logging instead of throwing when it fails.
+  void Store(std::string_view payload) const;
+
+ private:
+  std::string filename_;
+  uint64_t key_;
+  std::unique_ptr<MappedFile> mapped_;
+};
+
+// A process-wide store of prepared weights, so that backend instances using
+// the same network with the same layout (e.g. the children of roundrobin or
+// demux) share one read-only copy instead of each holding their own.
+template <typename T>
+class SharedWeightsStore {
+ public:
+  // Returns the weights stored under @key if some instance still holds them,
+  // otherwise creates them by calling @make, which returns std::unique_ptr<T>.
+  template <typename Make>
+  std::shared_ptr<const T> Get(uint64_t key, Make make) {
+    // Preparing under the lock makes concurrent loads of the same network wait
+    // for the first one instead of preparing it twice.
+    Mutex::Lock lock(mutex_);
+    for (auto iter = weights_.begin(); iter != weights_.end();) {
+      iter = iter->second.expired() ? weights_.erase(iter) : std::next(iter);
+    }
+    if (auto weights = weights_[key].lock()) return weights;
+    std::shared_ptr<const T> weights = make();
+    weights_[key] = weights;
+    return weights;
+  }
+
+ private:
+  Mutex mutex_;
+  std::map<uint64_t, std::weak_ptr<const T>> weights_ GUARDED_BY(mutex_);
+};
+
+}  // namespace lczero
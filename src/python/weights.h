@@ -281,10 +281,7 @@ class GameState {
   }
 
   std::string as_string() const {
-    bool is_black = history_.IsBlackToMove();
-    return (is_black ? history_.Last().GetThemBoard()
-                     : history_.Last().GetBoard())
-        .DebugString();
+    return history_.Last().GetWhiteBoard().DebugString();
   }
 
  private:
@@ -31,16 +31,22 @@
   Program grant you additional permission to convey the resulting work.
 */
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
 #include <mutex>
 #include <random>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 
 #include "syzygy/syzygy.h"
 
@@ -80,6 +86,13 @@ typedef uint64_t Key;
 
 constexpr const char* kSuffix[] = {".rtbw", ".rtbm", ".rtbz"};
 constexpr uint32_t kMagic[] = {0x5d23e871, 0x88ac504b, 0xa50c66d7};
+
+// Number of entries of the probe_wdl result cache (8 MiB).
+constexpr size_t kWdlCacheSize = 1 << 20;
+// Low byte of a cache entry holds the valid flag, the WDL score and the probe
+// state, the rest of the bits are compared with the position key.
+constexpr uint64_t kWdlCacheKeyMask = ~uint64_t{0xff};
+constexpr uint64_t kWdlCacheValid = 0x80;
 enum { WDL, DTM, DTZ };
 
 enum { PIECE_ENC, FILE_ENC, RANK_ENC };
@@ -133,6 +146,12 @@ struct BaseEntry {
   uint8_t* data[3];
   map_t mapping[3];
   std::atomic<bool> ready[3];
+  // Table name, e.g. KQvKR.
+  char name[16];
+  // Number of pieces of every type, indexed like the pcs arrays.
+  uint8_t pieces[16];
+  // Whether the table was queued for prefetching.
+  std::atomic<bool> prefetched;
   uint8_t num;
   bool symmetric;
   bool hasPawns;
@@ -994,6 +1013,14 @@ class SyzygyTablebaseImpl {
   }
 
   ~SyzygyTablebaseImpl() {
+    if (prefetch_thread_.joinable()) {
+      {
+        Mutex::Lock lock(prefetch_mutex_);
+        stop_prefetch_ = true;
+      }
+      prefetch_cv_.notify_all();
+      prefetch_thread_.join();
+    }
     // if pathString was set there may be entries in need of cleaning.
     if (!paths_.empty()) {
       for (int i = 0; i < num_piece_entries_; i++)
@@ -1017,7 +1044,182 @@ class SyzygyTablebaseImpl {
     return probe_table(pos, wdl, success, DTZ);
   }
 
+  void set_map_populate(bool populate) { map_populate_ = populate; }
+
+  // Queues the tables with at most @max_pieces pieces for prefetching.
+  void prefetch_tables(int max_pieces) {
+    prefetch([&](const BaseEntry& be) { return be.num <= max_pieces; });
+  }
+
+  // Queues the tables of positions reachable from @pos for prefetching.
+  void prefetch_reachable(const ChessBoard& pos) {
+    uint8_t sides[2][8] = {};
+    for (int side = 0; side < 2; side++) {
+      const BitBoard pieces = side ? pos.theirs() : pos.ours();
+      sides[side][PAWN] = (pos.pawns() & pieces).count();
+      sides[side][KNIGHT] = (pos.knights() & pieces).count();
+      sides[side][BISHOP] = (pos.bishops() & pieces).count();
+      sides[side][ROOK] = (pos.rooks() & pieces).count();
+      sides[side][QUEEN] = (pos.queens() & pieces).count();
+    }
+    // Pieces can only be captured, but pawns can also promote to any piece.
+    auto reachable = [](const uint8_t* table, const uint8_t* side) {
+      if (table[PAWN] > side[PAWN]) return false;
+      int promotions = side[PAWN] - table[PAWN];
+      for (int type = KNIGHT; type <= QUEEN; type++) {
+        promotions -= std::max(0, table[type] - side[type]);
+      }
+      return promotions >= 0;
+    };
+    prefetch([&](const BaseEntry& be) {
+      const uint8_t* white = be.pieces;
+      const uint8_t* black = be.pieces + 8;
+      return (reachable(white, sides[0]) && reachable(black, sides[1])) ||
+             (reachable(white, sides[1]) && reachable(black, sides[0]));
+    });
+  }
+
  private:
+  template <typename Filter>
+  void prefetch(Filter filter) {
+    int queued = 0;
+    {
+      Mutex::Lock lock(prefetch_mutex_);
+      auto queue = [&](BaseEntry* be) {
+        if (be->prefetched || !filter(*be)) return;
+        be->prefetched = true;
+        prefetch_queue_.push_back(be);
+        queued++;
+      };
+      for (int i = 0; i < num_piece_entries_; i++) queue(&piece_entries_[i]);
+      for (int i = 0; i < num_pawn_entries_; i++) queue(&pawn_entries_[i]);
+      if (queued && !prefetch_thread_.joinable()) {
+        prefetch_thread_ = std::thread([this]() { prefetch_loop(); });
+      }
+    }
+    if (!queued) return;
+    CERR << "Prefetching " << queued << " Syzygy tables.";
+    prefetch_cv_.notify_one();
+  }
+
+  void prefetch_loop() {
+    int tables = 0;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+      BaseEntry* be;
+      {
+        Mutex::Lock lock(prefetch_mutex_);
+        if (prefetch_queue_.empty() && tables) {
+          const double seconds = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+          CERR << "Prefetched " << tables << " Syzygy tables ("
+               << bytes / (1024 * 1024) << " MiB) in " << seconds << "s.";
+          tables = 0;
+          bytes = 0;
+        }
+        prefetch_cv_.wait(lock.get_raw(), [&]() {
+          return stop_prefetch_ || !prefetch_queue_.empty();
+        });
+        if (stop_prefetch_) return;
+        if (!tables) start = std::chrono::steady_clock::now();
+        be = prefetch_queue_.front();
+        prefetch_queue_.pop_front();
+      }
+      tables++;
+      for (int type : {WDL, DTZ}) {
+        if (type == DTZ && !be->hasDtz) continue;
+        try {
+          if (!map_table(be, be->name, type)) continue;
+        } catch (const Exception& e) {
+          CERR << "Not prefetching Syzygy table " << be->name << kSuffix[type]
+               << ": " << e.what();
+          continue;
+        }
+        bytes += prefetch_table(be, type);
+      }
+    }
+  }
+
+  // Asks the OS to read the table ahead and touches all its pages, so that
+  // it's in memory before a probe needs it. Returns the number of bytes read.
+  size_t prefetch_table(BaseEntry* be, int type) {
+#ifndef _WIN32
+    const size_t size = be->mapping[type];
+    if (!fits_in_memory(size)) {
+      CERR << "Not prefetching Syzygy table " << be->name << kSuffix[type]
+           << ", not enough free memory.";
+      return 0;
+    }
+    madvise(be->data[type], size, MADV_WILLNEED);
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    // Large tables take a while to read, so stop requests are checked every
+    // few MiB.
+    constexpr size_t kStopCheckBytes = 4 * 1024 * 1024;
+    uint8_t sum = 0;
+    size_t i = 0;
+    for (; i < size; i += page_size) {
+      if (i % kStopCheckBytes < page_size &&
+          stop_prefetch_.load(std::memory_order_relaxed)) {
+        break;
+      }
+      sum += static_cast<volatile uint8_t*>(be->data[type])[i];
+    }
+    prefetch_checksum_ += sum;
+    return std::min(i, size);
+#else
+    (void)be;
+    (void)type;
+    return 0;
+#endif
+  }
+
+#ifndef _WIN32
+  // Whether @size bytes fit in half of the currently available memory.
+  static bool fits_in_memory(size_t size) {
+    return size <= available_memory() / 2;
+  }
+
+  // Memory which can be used without swapping. On Linux it's MemAvailable,
+  // which unlike free memory includes the page cache the kernel can reclaim.
+  // Elsewhere only free memory is known, so fewer tables are prefetched.
+  static size_t available_memory() {
+#ifdef __linux__
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+      constexpr std::string_view kKey = "MemAvailable:";
+      if (line.compare(0, kKey.size(), kKey) != 0) continue;
+      try {
+        return std::stoull(line.substr(kKey.size())) * 1024;
+      } catch (const std::exception&) {
+        break;
+      }
+    }
+#endif
+    const long pages = sysconf(_SC_AVPHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return 0;
+    return static_cast<size_t>(pages) * page_size;
+  }
+#endif
+
+  // Maps and initializes the table if it isn't yet. Returns false if it can't
+  // be mapped.
+  bool map_table(BaseEntry* be, const char* str, int type) {
+    // Use double-checked locking to reduce locking overhead
+    if (atomic_load_explicit(&be->ready[type], std::memory_order_acquire)) {
+      return true;
+    }
+    Mutex::Lock lock(ready_mutex_);
+    if (!atomic_load_explicit(&be->ready[type], std::memory_order_relaxed)) {
+      if (!init_table(be, str, type)) return false;
+      atomic_store_explicit(&be->ready[type], true, std::memory_order_release);
+    }
+    return true;
+  }
+
   std::string name_for_tb(const char* str, const char* suffix) {
     std::stringstream path_string_stream(paths_);
     std::string path;
@@ -1046,11 +1248,31 @@ class SyzygyTablebaseImpl {
       throw Exception("Corrupt tablebase file " + fname);
     }
     *mapping = statbuf.st_size;
-    base_address = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int flags = MAP_SHARED;
+    const bool populate = map_populate_ && fits_in_memory(statbuf.st_size);
+#ifdef MAP_POPULATE
+    if (populate) flags |= MAP_POPULATE;
+#endif
+    base_address = mmap(nullptr, statbuf.st_size, PROT_READ, flags, fd, 0);
     ::close(fd);
     if (base_address == MAP_FAILED) {
       throw Exception("Could not mmap() " + fname);
     }
+    if (populate) {
+      bool huge_pages = false;
+#ifdef MADV_HUGEPAGE
+      huge_pages = madvise(base_address, statbuf.st_size, MADV_HUGEPAGE) == 0;
+#endif
+      if (!populate_reported_.exchange(true)) {
+#ifdef MAP_POPULATE
+        CERR << "Mapping Syzygy tables with MAP_POPULATE, huge pages "
+             << (huge_pages ? "enabled." : "not supported.");
+#else
+        CERR << "MAP_POPULATE is not supported, huge pages "
+             << (huge_pages ? "enabled." : "not supported.");
+#endif
+      }
+    }
 #else
     const HANDLE fd =
         CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
@@ -1129,6 +1351,9 @@ class SyzygyTablebaseImpl {
     be->symmetric = key == key2;
     be->num = 0;
     for (int i = 0; i < 16; i++) be->num += pcs[i];
+    snprintf(be->name, sizeof(be->name), "%s", str);
+    for (int i = 0; i < 16; i++) be->pieces[i] = pcs[i];
+    be->prefetched = false;
 
     num_wdl_++;
     num_dtm_ += be->hasDtm = test_tb(str, kSuffix[DTM]);
@@ -1336,19 +1561,13 @@ class SyzygyTablebaseImpl {
       return 0;
     }
 
-    // Use double-checked locking to reduce locking overhead
     if (!atomic_load_explicit(&be->ready[type], std::memory_order_acquire)) {
-      Mutex::Lock lock(ready_mutex_);
-      if (!atomic_load_explicit(&be->ready[type], std::memory_order_relaxed)) {
-        char str[16];
-        prt_str(pos, str, be->key != key);
-        if (!init_table(be, str, type)) {
-          tb_hash_[hash_idx].ptr = nullptr;  // mark as deleted
-          *success = 0;
-          return 0;
-        }
-        atomic_store_explicit(&be->ready[type], true,
-                              std::memory_order_release);
+      char str[16];
+      prt_str(pos, str, be->key != key);
+      if (!map_table(be, str, type)) {
+        tb_hash_[hash_idx].ptr = nullptr;  // mark as deleted
+        *success = 0;
+        return 0;
       }
     }
 
@@ -1445,6 +1664,18 @@ class SyzygyTablebaseImpl {
   Mutex ready_mutex_;
   std::string paths_;
 
+  std::atomic<bool> map_populate_{false};
+  std::atomic<bool> populate_reported_{false};
+
+  Mutex prefetch_mutex_;
+  std::condition_variable prefetch_cv_;
+  std::deque<BaseEntry*> prefetch_queue_ GUARDED_BY(prefetch_mutex_);
+  // Set under prefetch_mutex_, also read without it while prefetching.
+  std::atomic<bool> stop_prefetch_{false};
+  std::thread prefetch_thread_;
+  // Keeps the page touching loop from being optimized out.
+  uint8_t prefetch_checksum_ = 0;
+
   int num_piece_entries_ = 0;
   int num_pawn_entries_ = 0;
   int num_wdl_ = 0;
@@ -1464,13 +1695,36 @@ bool SyzygyTablebase::init(const std::string& paths) {
   paths_ = paths;
   impl_.reset(new SyzygyTablebaseImpl(paths_));
   max_cardinality_ = impl_->max_cardinality();
+  wdl_cache_.clear();
   if (max_cardinality_ <= 2) {
     impl_ = nullptr;
     return false;
   }
+  impl_->set_map_populate(map_populate_);
+  wdl_cache_ = std::vector<std::atomic<uint64_t>>(kWdlCacheSize);
   return true;
 }
 
+void SyzygyTablebase::set_map_populate(bool populate) {
+  map_populate_ = populate;
+  if (impl_) impl_->set_map_populate(populate);
+}
+
+void SyzygyTablebase::prefetch_tables(int max_pieces) {
+  if (impl_) impl_->prefetch_tables(max_pieces);
+}
+
+void SyzygyTablebase::prefetch_reachable(const Position& pos,
+                                         int extra_pieces) {
+  if (!impl_) return;
+  const ChessBoard& board = pos.GetBoard();
+  if (board.ours().count() + board.theirs().count() >
+      max_cardinality_ + extra_pieces) {
+    return;
+  }
+  impl_->prefetch_reachable(board);
+}
+
 // For a position where the side to move has a winning capture it is not
 // necessary to store a winning value so the generator treats such positions as
 // "don't cares" and tries to assign to it a value that improves the compression
@@ -1542,8 +1796,38 @@ WDLScore SyzygyTablebase::search(const Position& pos, ProbeState* result) {
 //  1 : win, but draw under 50-move rule
 //  2 : win
 WDLScore SyzygyTablebase::probe_wdl(const Position& pos, ProbeState* result) {
+  if (wdl_cache_.empty()) {
+    *result = OK;
+    return search(pos, result);
+  }
+  WDLScore wdl;
+  if (probe_wdl_cached(pos, &wdl, result)) return wdl;
+  wdl_cache_misses_.fetch_add(1, std::memory_order_relaxed);
   *result = OK;
-  return search(pos, result);
+  wdl = search(pos, result);
+  // The result only depends on the board, whose hash covers the material.
+  const uint64_t key = pos.GetBoard().Hash();
+  auto& entry = wdl_cache_[key % wdl_cache_.size()];
+  entry.store((key & kWdlCacheKeyMask) | kWdlCacheValid |
+                  (static_cast<uint64_t>(wdl + 2) << 2) |
+                  static_cast<uint64_t>(*result + 1),
+              std::memory_order_relaxed);
+  return wdl;
+}
+
+bool SyzygyTablebase::probe_wdl_cached(const Position& pos, WDLScore* wdl,
+                                       ProbeState* result) {
+  if (wdl_cache_.empty()) return false;
+  const uint64_t key = pos.GetBoard().Hash();
+  const uint64_t cached =
+      wdl_cache_[key % wdl_cache_.size()].load(std::memory_order_relaxed);
+  if (!(cached & kWdlCacheValid) || ((cached ^ key) & kWdlCacheKeyMask) != 0) {
+    return false;
+  }
+  wdl_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+  *result = static_cast<ProbeState>(static_cast<int>(cached & 3) - 1);
+  *wdl = static_cast<WDLScore>(static_cast<int>((cached >> 2) & 7) - 2);
+  return true;
 }
 
 // Probe the DTZ table for a particular position.
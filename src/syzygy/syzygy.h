@@ -76,6 +76,11 @@ class SyzygyTablebase {
   // Result is only strictly valid for positions with 0 ply 50 move counter.
   // Probe state will return FAIL if the position is not in the tablebase.
   WDLScore probe_wdl(const Position& pos, ProbeState* result);
+  // Same as probe_wdl, but only answers from the result cache, so it never
+  // reads from the tables. Returns false if the position is not cached.
+  // Thread safe.
+  bool probe_wdl_cached(const Position& pos, WDLScore* wdl,
+                        ProbeState* result);
   // Probes DTZ tables for the given position to determine the number of ply
   // before a zeroing move under optimal play.
   // Thread safe.
@@ -97,6 +102,29 @@ class SyzygyTablebase {
   // Returns false if the position is not in the tablebase.
   // Safe moves are added to the safe_moves output paramater.
   bool root_probe_wdl(const Position& pos, std::vector<Move>* safe_moves);
+  // Number of probe_wdl calls answered from the result cache, and of those
+  // which had to probe the tables.
+  // Thread safe.
+  uint64_t wdl_cache_hits() const {
+    return wdl_cache_hits_.load(std::memory_order_relaxed);
+  }
+  uint64_t wdl_cache_misses() const {
+    return wdl_cache_misses_.load(std::memory_order_relaxed);
+  }
+  // Whether tables are mapped with MAP_POPULATE (and huge pages where
+  // supported), so that they are read in full when first used instead of page
+  // by page during probes. Only done while the table fits in free memory.
+  // Not thread safe, same as init.
+  void set_map_populate(bool populate);
+  // Reads all tables with at most max_pieces pieces into memory in a
+  // background thread.
+  // Thread safe.
+  void prefetch_tables(int max_pieces);
+  // Reads into memory in a background thread the tables of the positions
+  // which can still arise from pos, if it has at most extra_pieces pieces
+  // more than the largest tables.
+  // Thread safe.
+  void prefetch_reachable(const Position& pos, int extra_pieces);
 
  private:
   template <bool CheckZeroingMoves = false>
@@ -106,7 +134,13 @@ class SyzygyTablebase {
   // Caches the max_cardinality from the impl, as max_cardinality may be a hot
   // path.
   int max_cardinality_;
+  bool map_populate_ = false;
   std::unique_ptr<SyzygyTablebaseImpl> impl_;
+  // Fixed size cache of probe_wdl results, accessed without locks. Every entry
+  // packs the high bits of the position key with the score and probe state.
+  std::vector<std::atomic<uint64_t>> wdl_cache_;
+  std::atomic<uint64_t> wdl_cache_hits_{0};
+  std::atomic<uint64_t> wdl_cache_misses_{0};
 };
 
 }  // namespace lczero
@@ -42,7 +42,8 @@ namespace lczero {
 // recommend to automate this element-memory management.
 // Unlike LRUCache, doesn't even consider trying to support LRU order.
 // Does not support delete.
-// Does not support replace! Inserts to existing elements are silently ignored.
+// Inserts to existing elements are silently ignored, Replace() must be used to
+// overwrite them.
 // FIFO eviction.
 // Assumes that eviction while pinned is rare enough to not need to optimize
 // unpin for that case.
@@ -64,29 +65,14 @@ class HashKeyedCache {
   // Inserts the element under key @key with value @val. Unless the key is
   // already in the cache.
   void Insert(uint64_t key, std::unique_ptr<V> val) {
-    if (capacity_.load(std::memory_order_relaxed) == 0) return;
-
-    SpinMutex::Lock lock(mutex_);
-
-    size_t idx = key % hash_.size();
-    while (true) {
-      if (!hash_[idx].in_use) break;
-      if (hash_[idx].key == key) {
-        // Already exists.
-        return;
-      }
-      ++idx;
-      if (idx >= hash_.size()) idx -= hash_.size();
-    }
-    hash_[idx].key = key;
-    hash_[idx].value = std::move(val);
-    hash_[idx].pins = 0;
-    hash_[idx].in_use = true;
-    insertion_order_.push_back(key);
-    ++size_;
-    ++allocated_;
+    InsertOrReplace(key, std::move(val), false);
+  }
 
-    EvictToCapacity(capacity_);
+  // Inserts the element under key @key with value @val, replacing the one
+  // already there if any. A replaced element which is pinned stays alive until
+  // unpinned, like an evicted one.
+  void Replace(uint64_t key, std::unique_ptr<V> val) {
+    InsertOrReplace(key, std::move(val), true);
   }
 
   // Checks whether a key exists. Doesn't pin. Of course the next moment the
@@ -221,6 +207,40 @@ class HashKeyedCache {
     bool in_use = false;
   };
 
+  void InsertOrReplace(uint64_t key, std::unique_ptr<V> val, bool replace) {
+    if (capacity_.load(std::memory_order_relaxed) == 0) return;
+
+    SpinMutex::Lock lock(mutex_);
+
+    size_t idx = key % hash_.size();
+    while (true) {
+      if (!hash_[idx].in_use) break;
+      if (hash_[idx].key == key) {
+        // Already exists.
+        if (!replace) return;
+        if (hash_[idx].pins > 0) {
+          evicted_.emplace_back(key, std::move(hash_[idx].value));
+          evicted_.back().pins = hash_[idx].pins;
+          hash_[idx].pins = 0;
+          ++allocated_;
+        }
+        hash_[idx].value = std::move(val);
+        return;
+      }
+      ++idx;
+      if (idx >= hash_.size()) idx -= hash_.size();
+    }
+    hash_[idx].key = key;
+    hash_[idx].value = std::move(val);
+    hash_[idx].pins = 0;
+    hash_[idx].in_use = true;
+    insertion_order_.push_back(key);
+    ++size_;
+    ++allocated_;
+
+    EvictToCapacity(capacity_);
+  }
+
   void EvictItem() REQUIRES(mutex_) {
     --size_;
     uint64_t key = insertion_order_.front();
@@ -322,7 +342,7 @@ class HashKeyedCacheLock {
 
  private:
   HashKeyedCache<V>* cache_ = nullptr;
-  uint64_t key_;
+  uint64_t key_ = 0;
   V* value_ = nullptr;
 };
 
@@ -0,0 +1,128 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2022 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+
+#include "utils/cpu_features.h"
+
+#include <cstdint>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define CPU_FEATURES_X86
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#define CPU_FEATURES_X86
+#endif
+
+namespace lczero {
+namespace {
+
+#ifdef CPU_FEATURES_X86
+void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuidex(info, leaf, subleaf);
+  for (int i = 0; i < 4; i++) regs[i] = info[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// The register state the OS saves on context switch, AVX and AVX-512 are only
+// usable when it covers their registers.
+uint64_t Xgetbv() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features;
+#ifdef CPU_FEATURES_X86
+  uint32_t regs[4];
+  Cpuid(0, 0, regs);
+  const uint32_t max_leaf = regs[0];
+  if (max_leaf < 1) return features;
+
+  Cpuid(1, 0, regs);
+  features.popcnt = regs[2] & (1u << 23);
+  const bool osxsave = regs[2] & (1u << 27);
+  const uint64_t xcr0 = osxsave ? Xgetbv() : 0;
+  // XMM and YMM state.
+  const bool os_avx = (xcr0 & 0x6) == 0x6;
+  // Additionally opmask and ZMM state.
+  const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+  const bool avx = os_avx && (regs[2] & (1u << 28));
+  features.fma = avx && (regs[2] & (1u << 12));
+  features.f16c = avx && (regs[2] & (1u << 29));
+
+  if (max_leaf >= 7) {
+    Cpuid(7, 0, regs);
+    features.avx2 = avx && (regs[1] & (1u << 5));
+    features.bmi2 = regs[1] & (1u << 8);
+    features.avx512f = os_avx512 && (regs[1] & (1u << 16));
+  }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  // Always there on 64 bit ARM.
+  features.neon = true;
+#elif defined(__ARM_NEON)
+  features.neon = true;
+#endif
+  return features;
+}
+
+}  // namespace
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+std::string CpuFeaturesString() {
+  const auto& features = GetCpuFeatures();
+  std::string result;
+  const auto add = [&result](bool present, const char* name) {
+    if (!present) return;
+    if (!result.empty()) result += ' ';
+    result += name;
+  };
+  add(features.popcnt, "popcnt");
+  add(features.bmi2, "bmi2");
+  add(features.f16c, "f16c");
+  add(features.fma, "fma");
+  add(features.avx2, "avx2");
+  add(features.avx512f, "avx512f");
+  add(features.neon, "neon");
+  return result.empty() ? "none" : result;
+}
+
+}  // namespace lczero
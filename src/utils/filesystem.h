@@ -29,6 +29,7 @@
 
 #include <time.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace lczero {
@@ -65,4 +66,24 @@ std::vector<std::string> GetSystemConfigDirectoryList();
 // Returns a vector of base directories to search for data files.
 std::vector<std::string> GetSystemDataDirectoryList();
 
+// Read-only memory mapping of a whole file. Throws exception if cannot.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view data() const {
+    return {static_cast<const char*>(data_), size_};
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* mapping_ = nullptr;
+#endif
+};
+
 }  // namespace lczero
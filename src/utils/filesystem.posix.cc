@@ -31,7 +31,10 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 namespace lczero {
 
@@ -172,4 +175,28 @@ std::vector<std::string> GetSystemDataDirectoryList() {
 #endif
 }
 
+MappedFile::MappedFile(const std::string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw Exception("Cannot open file: " + filename);
+  struct stat s;
+  if (fstat(fd, &s) < 0) {
+    close(fd);
+    throw Exception("Cannot stat file: " + filename);
+  }
+  size_ = s.st_size;
+  if (size_ > 0) {
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw Exception("Cannot map file: " + filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
+
 }  // namespace lczero
@@ -92,4 +92,34 @@ std::vector<std::string> GetSystemDataDirectoryList() {
 }
 
 
+MappedFile::MappedFile(const std::string& filename) {
+  const auto file =
+      CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw Exception("Cannot open file: " + filename);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw Exception("Cannot stat file: " + filename);
+  }
+  size_ = size.QuadPart;
+  if (size_ > 0) {
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  }
+  // The mapping stays valid after closing the file.
+  CloseHandle(file);
+  if (size_ > 0 && !data_) {
+    if (mapping_) CloseHandle(mapping_);
+    throw Exception("Cannot map file: " + filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) UnmapViewOfFile(data_);
+  if (mapping_) CloseHandle(mapping_);
+}
+
 }  // namespace lczero
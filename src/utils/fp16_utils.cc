@@ -38,8 +38,31 @@
 #define NO_F16C
 #endif
 
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+#if !defined(NO_F16C) && defined(__GNUC__) && !defined(__F16C__)
+// Not built for F16C, the processor may still have it.
+#include "utils/cpu_features.h"
+#define RUNTIME_F16C
+#endif
+
 namespace lczero {
 
+#ifdef RUNTIME_F16C
+namespace {
+__attribute__((target("avx,f16c"))) void FP16toFP32F16C(const uint16_t* input,
+                                                         float* output,
+                                                         size_t count) {
+  for (size_t i = 0; i < count; i += 8) {
+    __m128i H = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm256_storeu_ps(output + i, _mm256_cvtph_ps(H));
+  }
+}
+}  // namespace
+#endif
+
 uint16_t FP32toFP16(float f32) {
 #if defined(NO_POPCNT) || defined(NO_F16C) || \
     (defined(__GNUC__) && !defined(__F16C__))
@@ -104,4 +127,78 @@ float FP16toFP32(uint16_t f16) {
 #endif
 }
 
+uint16_t FP32toBF16(float f32) {
+  unsigned int x;
+  memcpy(&x, &f32, sizeof(float));
+  if ((x & 0x7fffffff) > 0x7f800000) {
+    // Truncation could turn a NaN into infinity, keep it a (quiet) NaN.
+    return (x >> 16) | 0x40;
+  }
+  // Round to nearest even.
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+float BF16toFP32(uint16_t bf16) {
+  unsigned int x = static_cast<unsigned int>(bf16) << 16;
+  float f;
+  memcpy(&f, &x, sizeof(float));
+  return f;
+}
+
+void FP32toFP16(const float* input, uint16_t* output, size_t count) {
+  for (size_t i = 0; i < count; i++) output[i] = FP32toFP16(input[i]);
+}
+
+void FP16toFP32(const uint16_t* input, float* output, size_t count) {
+  size_t i = 0;
+#if defined(NO_POPCNT) || defined(NO_F16C) || \
+    (defined(__GNUC__) && !defined(__F16C__))
+#if defined(__aarch64__) || defined(_M_ARM64)
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(output + i,
+              vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(input + i))));
+  }
+#elif defined(RUNTIME_F16C)
+  if (GetCpuFeatures().f16c) {
+    i = count - count % 8;
+    FP16toFP32F16C(input, output, i);
+  }
+#endif
+#else
+  for (; i + 8 <= count; i += 8) {
+    __m128i H = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm256_storeu_ps(output + i, _mm256_cvtph_ps(H));
+  }
+#endif
+  for (; i < count; i++) output[i] = FP16toFP32(input[i]);
+}
+
+const char* FP16toFP32PathName() {
+#if defined(NO_POPCNT) || defined(NO_F16C) || \
+    (defined(__GNUC__) && !defined(__F16C__))
+#if defined(__aarch64__) || defined(_M_ARM64)
+  return "neon";
+#elif defined(RUNTIME_F16C)
+  return GetCpuFeatures().f16c ? "f16c" : "generic";
+#else
+  return "generic";
+#endif
+#else
+  return "f16c";
+#endif
+}
+
+void FP32toBF16(const float* input, uint16_t* output, size_t count) {
+  for (size_t i = 0; i < count; i++) output[i] = FP32toBF16(input[i]);
+}
+
+void BF16toFP32(const uint16_t* input, float* output, size_t count) {
+  // Simple enough for the compiler to vectorize.
+  for (size_t i = 0; i < count; i++) {
+    unsigned int x = static_cast<unsigned int>(input[i]) << 16;
+    memcpy(&output[i], &x, sizeof(float));
+  }
+}
+
 }  // namespace lczero
@@ -25,9 +25,25 @@
   Program grant you additional permission to convey the resulting work.
 */
 #pragma once
+
+#include <cstddef>
+#include <cstdint>
+
 namespace lczero {
 
 uint16_t FP32toFP16(float f32);
 float FP16toFP32(uint16_t f16);
 
+uint16_t FP32toBF16(float f32);
+float BF16toFP32(uint16_t bf16);
+
+// Array versions of the above, vectorized where the cpu allows it.
+void FP32toFP16(const float* input, uint16_t* output, size_t count);
+void FP16toFP32(const uint16_t* input, float* output, size_t count);
+void FP32toBF16(const float* input, uint16_t* output, size_t count);
+void BF16toFP32(const uint16_t* input, float* output, size_t count);
+
+// Name of the path the array fp16 to fp32 expansion takes on this processor.
+const char* FP16toFP32PathName();
+
 }  // namespace lczero
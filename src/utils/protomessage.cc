@@ -58,13 +58,41 @@ std::string EncodeVarInt(std::uint64_t val) {
   }
 }
 
+// Owner of the buffer being parsed by ParseFromBorrowedString() on this
+// thread, if any.
+thread_local const std::shared_ptr<const void>* borrowed_owner = nullptr;
+
 }  // namespace
 
+ProtoBytes& ProtoBytes::operator=(std::string_view value) {
+  if (borrowed_owner) {
+    owner_ = *borrowed_owner;
+    view_ = value;
+  } else {
+    auto copy = std::make_shared<const std::string>(value);
+    view_ = *copy;
+    owner_ = std::move(copy);
+  }
+  return *this;
+}
+
 void ProtoMessage::ParseFromString(std::string_view str) {
   Clear();
   return MergeFromString(str);
 }
 
+void ProtoMessage::ParseFromBorrowedString(std::string_view str,
+                                           std::shared_ptr<const void> owner) {
+  borrowed_owner = &owner;
+  try {
+    ParseFromString(str);
+  } catch (...) {
+    borrowed_owner = nullptr;
+    throw;
+  }
+  borrowed_owner = nullptr;
+}
+
 void ProtoMessage::MergeFromString(std::string_view str) {
   const std::uint8_t* iter = reinterpret_cast<const std::uint8_t*>(str.data());
   const std::uint8_t* const end = iter + str.size();
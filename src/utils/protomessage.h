@@ -4,6 +4,7 @@
 #include <cstring>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <array>
@@ -19,6 +20,20 @@
 
 namespace lczero {
 
+// Value of an optional bytes field. Either an own copy, or when parsed with
+// ProtoMessage::ParseFromBorrowedString(), a view into the parsed buffer that
+// keeps it alive. Copies of the message share the data.
+class ProtoBytes {
+ public:
+  ProtoBytes() = default;
+  ProtoBytes& operator=(std::string_view value);
+  operator std::string_view() const { return view_; }
+
+ private:
+  std::string_view view_;
+  std::shared_ptr<const void> owner_;
+};
+
 class ProtoMessage {
  public:
   virtual ~ProtoMessage() {}
@@ -26,6 +41,11 @@ class ProtoMessage {
 
   void ParseFromString(std::string_view);
   void MergeFromString(std::string_view);
+  // Same as ParseFromString(), except that bytes fields are not copied but
+  // point into @str. @owner keeps @str alive while the message or any of its
+  // copies refers to it.
+  void ParseFromBorrowedString(std::string_view str,
+                               std::shared_ptr<const void> owner);
   virtual std::string OutputAsString() const = 0;
 
  protected:
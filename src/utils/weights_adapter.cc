@@ -27,20 +27,40 @@
 
 #include "src/utils/weights_adapter.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace lczero {
 float LayerAdapter::Iterator::ExtractValue(const uint16_t* ptr,
                                            const LayerAdapter* adapter) {
-  return *ptr / static_cast<float>(0xffff) * adapter->range_ + adapter->min_;
+  // The data may come from a memory mapped file and be unaligned.
+  uint16_t value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value * adapter->scale_ + adapter->min_;
 }
 
 LayerAdapter::LayerAdapter(const pblczero::Weights::Layer& layer)
     : data_(reinterpret_cast<const uint16_t*>(layer.params().data())),
       size_(layer.params().size() / sizeof(uint16_t)),
       min_(layer.min_val()),
-      range_(layer.max_val() - min_) {}
+      scale_((layer.max_val() - min_) / static_cast<float>(0xffff)) {}
 
 std::vector<float> LayerAdapter::as_vector() const {
-  return std::vector<float>(begin(), end());
+  // Decodes in chunks with a plain loop that the compiler can vectorize,
+  // instead of going through the iterator one value at a time. The formula is
+  // the same as in ExtractValue so the results are identical.
+  constexpr size_t kChunk = 256;
+  std::vector<float> result(size_);
+  uint16_t values[kChunk];
+  for (size_t start = 0; start < size_; start += kChunk) {
+    const size_t count = std::min(kChunk, size_ - start);
+    std::memcpy(values, data_ + start, count * sizeof(uint16_t));
+    float* out = result.data() + start;
+    for (size_t i = 0; i < count; i++) {
+      out[i] = values[i] * scale_ + min_;
+    }
+  }
+  return result;
 }
 float LayerAdapter::Iterator::operator*() const {
   return ExtractValue(data_, adapter_);
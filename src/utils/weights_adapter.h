@@ -90,7 +90,8 @@ class LayerAdapter {
   const uint16_t* data_ = nullptr;
   const size_t size_ = 0;
   const float min_;
-  const float range_;
+  // Step between two quantized values, (max - min) / 0xffff.
+  const float scale_;
 };
 
 }  // namespace lczero